@@ -0,0 +1,113 @@
+# end-to-end training throughput suite
+#
+# Generates synthetic corpora with bin/gen_corpus and trains lightlda over
+# a matrix of (topics, vocabs, threads, mh_steps, data mode). Each run keeps
+# its per-slice metrics in <output_dir>/<run>/metrics.jsonl, and one JSON
+# line per (run, iteration) with tokens/sec and likelihood is appended to
+# <output_dir>/summary.jsonl.
+#
+# Usage: sh bench/e2e_suite.sh [output_dir]
+# The matrix can be overridden by environment variables, e.g.
+#   TOPICS="1000 10000" THREADS="8" MODES="out_of_core" sh bench/e2e_suite.sh
+
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+BIN=$ROOT/bin
+OUTPUT=$(mkdir -p "${1:-$ROOT/e2e_results}" && cd "${1:-$ROOT/e2e_results}" && pwd)
+
+TOPICS=${TOPICS:-"100 1000"}
+VOCABS=${VOCABS:-"10000 100000"}
+THREADS=${THREADS:-"1 4"}
+MH_STEPS=${MH_STEPS:-"1 2"}
+MODES=${MODES:-"memory out_of_core"}
+NUM_DOCS=${NUM_DOCS:-20000}
+DOC_LENGTH=${DOC_LENGTH:-200}
+NUM_BLOCKS=${NUM_BLOCKS:-2}
+ITERATIONS=${ITERATIONS:-10}
+EXTRA_FLAGS=${EXTRA_FLAGS:-""}
+
+for bin in gen_corpus lightlda; do
+    if [ ! -x "$BIN/$bin" ]; then
+        echo "Missing $BIN/$bin, run make first"
+        exit 1
+    fi
+done
+
+# summarize <metrics_file> <run_fields>
+summarize() {
+    awk -v run="$2" '
+    function field(name,    pattern) {
+        pattern = "\"" name "\":[^,}]*"
+        if (!match($0, pattern)) return ""
+        return substr($0, RSTART + length(name) + 3, RLENGTH - length(name) - 3)
+    }
+    {
+        iter = field("iteration")
+        if (!(iter in tokens)) order[n++] = iter
+        tokens[iter] += field("tokens")
+        seconds[iter] += field("train_seconds")
+        stall[iter] += field("io_stall_seconds")
+        if (field("doc_llh") != "null") doc[iter] += field("doc_llh")
+        if (field("word_llh") != "null") word[iter] += field("word_llh")
+        if (field("normalized_llh") != "null") norm[iter] = field("normalized_llh")
+    }
+    END {
+        for (i = 0; i < n; ++i) {
+            iter = order[i]
+            printf "{%s,\"iteration\":%d,\"tokens\":%d,\"seconds\":%.6f,", \
+                run, iter, tokens[iter], seconds[iter]
+            printf "\"tokens_per_sec\":%.1f,\"io_stall_seconds\":%.6f", \
+                (seconds[iter] > 0 ? tokens[iter] / seconds[iter] : 0), stall[iter]
+            if (iter in doc)
+                printf ",\"doc_llh\":%.6e", doc[iter]
+            else
+                printf ",\"doc_llh\":null"
+            if (iter in word && iter in norm)
+                printf ",\"word_llh\":%.6e", word[iter] + norm[iter]
+            else
+                printf ",\"word_llh\":null"
+            printf "}\n"
+        }
+    }' "$1"
+}
+
+for topics in $TOPICS; do
+for vocabs in $VOCABS; do
+    data_dir=$OUTPUT/data/k${topics}_v${vocabs}
+    if [ ! -f "$data_dir/lightlda.flags" ]; then
+        mkdir -p "$data_dir"
+        "$BIN/gen_corpus" -output_dir "$data_dir" -num_vocabs "$vocabs" \
+            -num_topics "$topics" -num_docs "$NUM_DOCS" \
+            -num_blocks "$NUM_BLOCKS" -doc_length "$DOC_LENGTH" || exit 1
+    fi
+    data_flags=$(cat "$data_dir/lightlda.flags")
+
+    for threads in $THREADS; do
+    for mh_steps in $MH_STEPS; do
+    for mode in $MODES; do
+        run=k${topics}_v${vocabs}_t${threads}_mh${mh_steps}_${mode}
+        run_dir=$OUTPUT/$run
+        mkdir -p "$run_dir"
+        mode_flags=""
+        if [ "$mode" = "out_of_core" ]; then
+            mode_flags="-out_of_core"
+        fi
+        echo "Running $run"
+        # lightlda writes logs and doc_topic files to the working directory
+        (cd "$run_dir" && "$BIN/lightlda" $data_flags $mode_flags $EXTRA_FLAGS \
+            -input_dir "$data_dir" -num_iterations "$ITERATIONS" \
+            -mh_steps "$mh_steps" -num_local_workers "$threads" \
+            -metrics_file "$run_dir/metrics.jsonl" > "$run_dir/stdout.log" 2>&1)
+        if [ $? -ne 0 ]; then
+            echo "Run $run failed, see $run_dir/stdout.log"
+            continue
+        fi
+        fields="\"run\":\"$run\",\"topics\":$topics,\"vocabs\":$vocabs"
+        fields="$fields,\"threads\":$threads,\"mh_steps\":$mh_steps,\"mode\":\"$mode\""
+        summarize "$run_dir/metrics.jsonl" "$fields" >> "$OUTPUT/summary.jsonl"
+    done
+    done
+    done
+done
+done
+
+echo "Results are in $OUTPUT/summary.jsonl"
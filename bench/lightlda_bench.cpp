@@ -0,0 +1,515 @@
+/*!
+ * \file lightlda_bench.cpp
+ * \brief Microbenchmarks for the components on the sampling hot path.
+ *  Every benchmark runs against a LocalModel filled from a synthetic
+ *  Zipfian corpus, so no parameter server is needed. Results are printed
+ *  as one JSON object per line for comparison between commits.
+ */
+
+#include "alias_table.h"
+#include "common.h"
+#include "data_block.h"
+#include "document.h"
+#include "eval.h"
+#include "meta.h"
+#include "model.h"
+#include "sampler.h"
+#include "util.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <multiverso/log.h>
+#include <multiverso/row.h>
+#include <multiverso/stop_watch.h>
+
+namespace multiverso { namespace lightlda
+{
+    /*! \brief Grants the benchmarks access to the MH samplers */
+    class SamplerBenchmark
+    {
+    public:
+        static void DocInit(LightDocSampler& sampler, Document* doc)
+        {
+            sampler.DocInit(doc);
+        }
+        static int32_t Sample(LightDocSampler& sampler, Document* doc,
+            int32_t word, int32_t old_topic, ModelBase* model,
+            AliasTable* alias, bool approx)
+        {
+            const WordHandle& handle = alias->handle(word);
+            Row<int64_t>& summary_row = model->GetSummaryRow();
+            return approx
+                ? sampler.ApproxSample(doc, handle, summary_row, old_topic,
+                    old_topic, alias)
+                : sampler.Sample(doc, handle, summary_row, old_topic,
+                    old_topic, alias);
+        }
+    };
+
+namespace
+{
+    /*! \brief Settings of the benchmark run */
+    struct BenchConfig
+    {
+        std::vector<int32_t> topics = { 100, 1000, 10000, 100000 };
+        int32_t num_vocabs = 50000;
+        int64_t num_tokens = 1000000;
+        int32_t doc_length = 200;
+        int32_t topics_per_doc = 8;
+        double zipf_exponent = 1.0;
+        double min_seconds = 0.2;
+        int32_t repeats = 5;
+        std::string filter = "";
+        std::string tag = "";
+        std::string output = "";
+        std::string io_dir = ".";
+    };
+
+    /*! \brief prefetch distance of the sample_doc benchmark */
+    const int32_t kPrefetchTokens = 4;
+
+    BenchConfig config;
+    FILE* output = stdout;
+    volatile int64_t sink = 0;
+
+    /*! \brief Synthetic corpus in the same layout as a DataBlock */
+    struct Corpus
+    {
+        std::vector<int32_t> buffer;
+        std::vector<Document> docs;
+        std::vector<int32_t> tf;
+        std::vector<int32_t> tokens;
+        std::vector<int32_t> dense_words;
+        std::vector<int32_t> sparse_words;
+    };
+
+    void PrintUsage()
+    {
+        printf("LightLDA microbenchmark usage: \n");
+        printf("-topics <list>           Comma separated number of topics. Default: 100,1000,10000,100000\n");
+        printf("-num_vocabs <arg>        Size of synthetic vocabulary. Default: 50000\n");
+        printf("-num_tokens <arg>        Minimum number of synthetic tokens. Default: 1000000\n");
+        printf("-doc_length <arg>        Average document length. Default: 200\n");
+        printf("-zipf <arg>              Exponent of Zipfian word frequency. Default: 1.0\n");
+        printf("-min_time <arg>          Minimum seconds per measurement. Default: 0.2\n");
+        printf("-repeats <arg>           Number of measurements per benchmark. Default: 5\n");
+        printf("-filter <arg>            Only run benchmarks whose name contains arg\n");
+        printf("-tag <arg>               Label attached to every result, e.g. commit id\n");
+        printf("-output <arg>            Append results to file instead of stdout\n");
+        printf("-io_dir <arg>            Directory for the block I/O benchmark. Default: .\n");
+        exit(0);
+    }
+
+    void ParseArgs(int argc, char** argv)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            if (strcmp(argv[i], "-help") == 0 || strcmp(argv[i], "--help") == 0)
+            {
+                PrintUsage();
+            }
+            if (i + 1 == argc) break;
+            if (strcmp(argv[i], "-topics") == 0)
+            {
+                config.topics.clear();
+                for (char* p = strtok(argv[i + 1], ","); p != nullptr;
+                    p = strtok(nullptr, ","))
+                {
+                    config.topics.push_back(atoi(p));
+                }
+            }
+            if (strcmp(argv[i], "-num_vocabs") == 0) config.num_vocabs = atoi(argv[i + 1]);
+            if (strcmp(argv[i], "-num_tokens") == 0) config.num_tokens = atoll(argv[i + 1]);
+            if (strcmp(argv[i], "-doc_length") == 0) config.doc_length = atoi(argv[i + 1]);
+            if (strcmp(argv[i], "-zipf") == 0) config.zipf_exponent = atof(argv[i + 1]);
+            if (strcmp(argv[i], "-min_time") == 0) config.min_seconds = atof(argv[i + 1]);
+            if (strcmp(argv[i], "-repeats") == 0) config.repeats = atoi(argv[i + 1]);
+            if (strcmp(argv[i], "-filter") == 0) config.filter = argv[i + 1];
+            if (strcmp(argv[i], "-tag") == 0) config.tag = argv[i + 1];
+            if (strcmp(argv[i], "-output") == 0) config.output = argv[i + 1];
+            if (strcmp(argv[i], "-io_dir") == 0) config.io_dir = argv[i + 1];
+        }
+    }
+
+    /*!
+     * \brief Runs body repeatedly until it takes at least min_seconds,
+     *  and reports the median and minimum time per operation
+     * \param name benchmark name
+     * \param variant variant of the benchmark, e.g. dense or sparse
+     * \param num_topics number of topics of the model
+     * \param ops number of operations performed by one call of body
+     * \param body the code to measure
+     */
+    void Measure(const std::string& name, const std::string& variant,
+        int32_t num_topics, int64_t ops, const std::function<void()>& body)
+    {
+        if (ops <= 0) return;
+        if (name.find(config.filter) == std::string::npos) return;
+        body(); // warm up caches and thread local buffers
+        std::vector<double> ns_per_op;
+        for (int32_t r = 0; r < config.repeats; ++r)
+        {
+            int64_t total_ops = 0;
+            StopWatch watch; watch.Start();
+            do
+            {
+                body();
+                total_ops += ops;
+            } while (watch.ElapsedSeconds() < config.min_seconds);
+            ns_per_op.push_back(watch.ElapsedSeconds() * 1e9 / total_ops);
+        }
+        std::sort(ns_per_op.begin(), ns_per_op.end());
+        fprintf(output, "{\"benchmark\":\"%s\",\"variant\":\"%s\","
+            "\"num_topics\":%d,\"ops\":%lld,\"ns_per_op\":%.3f,"
+            "\"min_ns_per_op\":%.3f,\"tag\":\"%s\"}\n",
+            name.c_str(), variant.c_str(), num_topics,
+            static_cast<long long>(ops), ns_per_op[ns_per_op.size() / 2],
+            ns_per_op[0], config.tag.c_str());
+        fflush(output);
+    }
+
+    /*!
+     * \brief Generates documents with Zipfian words sorted by word id, as
+     *  in the training data. Each document mixes a few random topics so
+     *  that doc-topic and word-topic rows are skewed as in a trained model
+     */
+    void GenerateCorpus(int32_t num_topics, Corpus& corpus)
+    {
+        xorshift_rng rng;
+        std::vector<double> cdf(config.num_vocabs);
+        double sum = 0.0;
+        for (int32_t w = 0; w < config.num_vocabs; ++w)
+        {
+            sum += 1.0 / pow(w + 1.0, config.zipf_exponent);
+            cdf[w] = sum;
+        }
+        for (auto& p : cdf) p /= sum;
+
+        // Big enough that the frequent words get dense rows for any K
+        int64_t num_tokens = std::max(config.num_tokens,
+            static_cast<int64_t>(num_topics) * 20);
+        corpus.tf.assign(config.num_vocabs, 0);
+        corpus.buffer.clear();
+        corpus.buffer.reserve(num_tokens * 2 + num_tokens / config.doc_length * 2);
+        std::vector<int64_t> offsets(1, 0);
+        std::vector<int32_t> words, doc_topics(config.topics_per_doc);
+        for (int64_t token = 0; token < num_tokens; token += words.size())
+        {
+            int32_t length = 1 + rng.rand_k(2 * config.doc_length);
+            length = std::min(length, kMaxDocLength);
+            words.resize(length);
+            for (auto& word : words)
+            {
+                word = static_cast<int32_t>(std::lower_bound(cdf.begin(),
+                    cdf.end(), rng.rand_double()) - cdf.begin());
+                word = std::min(word, config.num_vocabs - 1);
+            }
+            std::sort(words.begin(), words.end());
+            for (auto& topic : doc_topics) topic = rng.rand_k(num_topics);
+
+            corpus.buffer.push_back(0); // cursor
+            for (auto word : words)
+            {
+                corpus.buffer.push_back(word);
+                corpus.buffer.push_back(
+                    doc_topics[rng.rand_k(config.topics_per_doc)]);
+                corpus.tokens.push_back(word);
+                ++corpus.tf[word];
+            }
+            offsets.push_back(corpus.buffer.size());
+        }
+        for (size_t i = 0; i + 1 < offsets.size(); ++i)
+        {
+            corpus.docs.emplace_back(corpus.buffer.data() + offsets[i],
+                corpus.buffer.data() + offsets[i + 1]);
+        }
+        for (int32_t w = 0; w < config.num_vocabs; ++w)
+        {
+            if (corpus.tf[w] == 0) continue;
+            if (AliasTable::IsDenseRow(corpus.tf[w]))
+                corpus.dense_words.push_back(w);
+            else
+                corpus.sparse_words.push_back(w);
+        }
+    }
+
+    void FillModel(const Corpus& corpus, LocalModel& model)
+    {
+        for (int32_t w = 0; w < config.num_vocabs; ++w)
+        {
+            if (corpus.tf[w] > 0) model.InitWordTopicRow(w, corpus.tf[w]);
+        }
+        for (auto& doc : corpus.docs)
+        {
+            for (int32_t i = 0; i < doc.Size(); ++i)
+            {
+                model.AddWordTopicRow(doc.Word(i), doc.Topic(i), 1);
+                model.AddSummaryRow(doc.Topic(i), 1);
+            }
+        }
+    }
+
+    /*! \brief Lays out alias rows of all words as Meta::BuildAliasIndex */
+    int64_t BuildAliasIndex(const Corpus& corpus, AliasTableIndex& index)
+    {
+        int64_t offset = 0;
+        for (int32_t w = 0; w < config.num_vocabs; ++w)
+        {
+            if (corpus.tf[w] == 0) continue;
+            bool is_dense = AliasTable::IsDenseRow(corpus.tf[w]);
+            int32_t capacity = is_dense ? Config::num_topics : corpus.tf[w];
+            index.PushWord(w, is_dense, offset, capacity);
+            offset += AliasTable::RowSize(is_dense, capacity);
+        }
+        return offset;
+    }
+
+    void BenchRng(int32_t num_topics)
+    {
+        const int64_t kOps = 1 << 20;
+        xorshift_rng rng;
+        Measure("xorshift_rng", "rand", num_topics, kOps, [&]()
+        {
+            int64_t sum = 0;
+            for (int64_t i = 0; i < kOps; ++i) sum += rng.rand();
+            sink += sum;
+        });
+        Measure("xorshift_rng", "rand_k", num_topics, kOps, [&]()
+        {
+            int64_t sum = 0;
+            for (int64_t i = 0; i < kOps; ++i) sum += rng.rand_k(num_topics);
+            sink += sum;
+        });
+    }
+
+    void BenchRowAt(int32_t num_topics)
+    {
+        const int32_t kNumKeys = 4096;
+        const int32_t kSparseEntries =
+            std::max(1, std::min(num_topics / 16, 256));
+        xorshift_rng rng;
+        Row<int32_t> dense(0, Format::Dense, num_topics);
+        Row<int32_t> sparse(0, Format::Sparse, kSparseEntries * kLoadFactor);
+        std::vector<int32_t> keys(kNumKeys);
+        for (int32_t i = 0; i < kSparseEntries; ++i)
+        {
+            int32_t topic = rng.rand_k(num_topics);
+            dense.Add(topic, 1);
+            sparse.Add(topic, 1);
+        }
+        // half of the lookups hit an existing key, as in the MH steps
+        for (int32_t i = 0; i < kNumKeys; ++i)
+        {
+            keys[i] = (i % 2 == 0) ? rng.rand_k(num_topics) : keys[i / 2];
+        }
+        Measure("row_at", "dense", num_topics, kNumKeys, [&]()
+        {
+            int64_t sum = 0;
+            for (auto key : keys) sum += dense.At(key);
+            sink += sum;
+        });
+        Measure("row_at", "sparse", num_topics, kNumKeys, [&]()
+        {
+            int64_t sum = 0;
+            for (auto key : keys) sum += sparse.At(key);
+            sink += sum;
+        });
+    }
+
+    void BenchModel(int32_t num_topics)
+    {
+        Config::num_topics = num_topics;
+        Config::num_vocabs = config.num_vocabs;
+        Corpus corpus;
+        GenerateCorpus(num_topics, corpus);
+        LocalModel model;
+        FillModel(corpus, model);
+
+        AliasTableIndex index;
+        int64_t alias_size = BuildAliasIndex(corpus, index);
+        Config::alias_capacity = alias_size * sizeof(int32_t);
+        AliasTable alias;
+        alias.Init(&index);
+
+        Measure("alias_build", "beta", num_topics, 1, [&]()
+        {
+            alias.Build(-1, &model);
+        });
+        Measure("alias_build", "dense", num_topics, corpus.dense_words.size(),
+            [&]()
+        {
+            for (auto word : corpus.dense_words) alias.Build(word, &model);
+        });
+        Measure("alias_build", "sparse", num_topics,
+            corpus.sparse_words.size(), [&]()
+        {
+            for (auto word : corpus.sparse_words) alias.Build(word, &model);
+        });
+        // Make sure every row is built before proposing from it
+        alias.Build(-1, &model);
+        for (auto word : corpus.dense_words) alias.Build(word, &model);
+        for (auto word : corpus.sparse_words) alias.Build(word, &model);
+
+        xorshift_rng rng;
+        Measure("alias_propose", "all", num_topics, corpus.tokens.size(),
+            [&]()
+        {
+            int64_t sum = 0;
+            for (auto word : corpus.tokens) sum += alias.Propose(word, rng);
+            sink += sum;
+        });
+
+        Row<int32_t> doc_topic_counter(0, Format::Sparse, kMaxDocLength);
+        Measure("doc_topic_vector", "all", num_topics, corpus.docs.size(),
+            [&]()
+        {
+            for (auto& doc : corpus.docs)
+            {
+                doc_topic_counter.Clear();
+                doc.GetDocTopicVector(doc_topic_counter);
+            }
+        });
+        Measure("doc_llh", "all", num_topics, corpus.docs.size(), [&]()
+        {
+            double llh = 0.0;
+            for (auto& doc : corpus.docs)
+            {
+                llh += Eval::ComputeOneDocLLH(&doc, doc_topic_counter);
+            }
+            sink += static_cast<int64_t>(llh);
+        });
+
+        // Topics are not written back, so every run sees the same state
+        LightDocSampler sampler;
+        for (int32_t approx = 0; approx < 2; ++approx)
+        {
+            Measure("sample", approx ? "approx" : "exact", num_topics,
+                corpus.tokens.size(), [&]()
+            {
+                int64_t sum = 0;
+                for (auto& doc : corpus.docs)
+                {
+                    SamplerBenchmark::DocInit(sampler, &doc);
+                    for (int32_t i = 0; i < doc.Size(); ++i)
+                    {
+                        sum += SamplerBenchmark::Sample(sampler, &doc,
+                            doc.Word(i), doc.Topic(i), &model, &alias,
+                            approx != 0);
+                    }
+                }
+                sink += sum;
+            });
+        }
+
+        // SampleOneDoc writes topics back, model rows are left unchanged as
+        // in inference so that sparse rows keep their capacity
+        Config::inference = true;
+        for (int32_t prefetch : { 0, kPrefetchTokens })
+        {
+            Config::prefetch_tokens = prefetch;
+            LightDocSampler doc_sampler;
+            Measure("sample_doc", prefetch ? "prefetch" : "plain", num_topics,
+                corpus.tokens.size(), [&]()
+            {
+                int64_t sum = 0;
+                for (auto& doc : corpus.docs)
+                {
+                    sum += doc_sampler.SampleOneDoc(&doc, 0,
+                        config.num_vocabs - 1, &model, &alias);
+                }
+                sink += sum;
+            });
+        }
+        Config::prefetch_tokens = 0;
+        Config::inference = false;
+        alias.Clear();
+    }
+
+    /*!
+     * \brief Reads and writes a block file of the synthetic corpus with
+     *  every I/O engine, one op is one byte of the file
+     */
+    void BenchBlockIO()
+    {
+        Corpus corpus;
+        GenerateCorpus(Config::num_topics, corpus);
+        std::vector<int64_t> offsets(1, 0);
+        for (auto& doc : corpus.docs)
+        {
+            offsets.push_back(offsets.back() + 1 + 2 * doc.Size());
+        }
+        int64_t num_docs = corpus.docs.size();
+        std::string file_name = config.io_dir + "/lightlda_bench.block";
+        {
+            std::ofstream file(file_name, std::ios::out | std::ios::binary);
+            file.write(reinterpret_cast<char*>(&num_docs), sizeof(int64_t));
+            file.write(reinterpret_cast<char*>(offsets.data()),
+                sizeof(int64_t)* offsets.size());
+            file.write(reinterpret_cast<char*>(corpus.buffer.data()),
+                sizeof(int32_t)* corpus.buffer.size());
+        }
+        int64_t file_size = sizeof(int64_t)* (offsets.size() + 1) +
+            sizeof(int32_t)* corpus.buffer.size();
+
+        Config::max_num_document = num_docs + 1;
+        Config::data_capacity = sizeof(int32_t)* corpus.buffer.size();
+        for (std::string engine : { "stream", "direct" })
+        {
+            Config::io_engine = engine;
+            DataBlock block;
+            Measure("block_io", "read_" + engine, 0, file_size, [&]()
+            {
+                block.Read(file_name);
+                sink += block.Size();
+            });
+            // Write keeps the buffers of the block, so it can be repeated
+            Measure("block_io", "write_" + engine, 0, file_size, [&]()
+            {
+                block.Write();
+            });
+        }
+        Config::io_engine = "stream";
+        remove(file_name.c_str());
+    }
+
+    void Run(int argc, char** argv)
+    {
+        ParseArgs(argc, argv);
+        if (!config.output.empty())
+        {
+            output = fopen(config.output.c_str(), "a");
+            if (output == nullptr)
+            {
+                Log::Fatal("Failed to open file %s\n", config.output.c_str());
+            }
+        }
+        for (auto num_topics : config.topics)
+        {
+            Config::num_topics = num_topics;
+            BenchRng(num_topics);
+            BenchRowAt(num_topics);
+            BenchModel(num_topics);
+        }
+        if (std::string("block_io").find(config.filter) != std::string::npos)
+        {
+            BenchBlockIO();
+        }
+        if (output != stdout) fclose(output);
+    }
+} // namespace
+} // namespace lightlda
+} // namespace multiverso
+
+int main(int argc, char** argv)
+{
+    multiverso::lightlda::Run(argc, argv);
+    return 0;
+}
@@ -17,18 +17,54 @@
 #define _THREAD_LOCAL thread_local 
 #endif
 
+#if defined(_MSC_VER)
+#include <xmmintrin.h>
+#define LIGHTLDA_PREFETCH(addr) \
+    _mm_prefetch(reinterpret_cast<const char*>(addr), _MM_HINT_T0)
+#else
+#define LIGHTLDA_PREFETCH(addr) __builtin_prefetch(addr)
+#endif
+
+namespace multiverso
+{
+    template <typename T>
+    class Row;
+}
+
 namespace multiverso { namespace lightlda
 {
     class ModelBase;
     class xorshift_rng;
     class AliasTableIndex;
 
+    /*!
+     * \brief WordHandle holds what sampling needs of a word of the current
+     *  slice, resolved once when its alias row is built, so sampling a
+     *  token does no table or hash lookup
+     */
+    struct WordHandle
+    {
+        /*! \brief word-topic row in the model */
+        Row<int32_t>* row;
+        /*! \brief alias row in the memory pool */
+        int32_t* alias_row;
+        /*! \brief number of buckets of the alias row */
+        int32_t capacity;
+        int32_t height;
+        float mass;
+        bool is_dense;
+    };
+
     /*!
      * \brief AliasTable is the storage for alias tables used for fast sampling
      *  from lightlda word proposal distribution. It optimize memory usage 
      *  through a hybrid storage by exploiting the sparsity of word proposal.
      *  AliasTable containes two part: 1) a memory pool to store the alias
      *  2) an index table to access each row
+     *  When the number of topics fits in 16 bits, each alias bucket is packed
+     *  into one 32-bit word: high 16 bits for the alias index and low 16 bits
+     *  for the fractional threshold. A dense row then takes num_topics ints
+     *  and a sparse row 2 ints per entry, instead of 2 and 3.
      */
     class AliasTable
     {
@@ -37,6 +73,7 @@ namespace multiverso { namespace lightlda
         ~AliasTable();
         /*!
          * \brief Set the table index. Must call this method before 
+         *  building or sampling a slice, from one thread
          */
         void Init(AliasTableIndex* table_index);
         /*!
@@ -53,17 +90,52 @@ namespace multiverso { namespace lightlda
          * \return sample proposed from the distribution
          */
         int Propose(int word, xorshift_rng& rng);
+        /*! \brief sample from word proposal distribution of a built word */
+        int32_t Propose(const WordHandle& handle, xorshift_rng& rng);
+        /*! \brief Get the handle of a word of the current slice */
+        const WordHandle& handle(int32_t word) const;
+        /*!
+         * \brief Prefetching the state of a word takes three stages, each
+         *  loading the addresses the next one prefetches: its position,
+         *  its handle, then its alias row. The counts of its model row are
+         *  not prefetched, as multiverso rows do not expose their storage
+         */
+        void PrefetchPosition(int32_t word) const;
+        void PrefetchHandle(int32_t word) const;
+        void PrefetchAliasRow(int32_t word) const;
         /*! \brief Clear the alias table */
         void Clear();
+        /*!
+         * \brief Whether a word with given term frequency uses dense alias row
+         * \param tf term frequency of the word
+         */
+        static bool IsDenseRow(int32_t tf);
+        /*!
+         * \brief Memory size of an alias row, in number of int32
+         * \param is_dense whether the row is dense
+         * \param capacity number of entries of the row
+         */
+        static int64_t RowSize(bool is_dense, int32_t capacity);
+        /*! \brief Whether alias rows use the packed 32-bit bucket layout */
+        static bool IsCompact();
     private:
         void AliasMultinomialRNG(int32_t size, float mass, int32_t& height,
             int32_t* kv_vector);
+        /*! \brief sample from the beta (smoothing) part of word proposal */
+        int32_t ProposeBeta(xorshift_rng& rng);
+        /*! \brief Packs the (alias, threshold) pairs into 32-bit buckets */
+        void PackAliasRow(int32_t size, int32_t height, 
+            const int32_t* kv_vector, uint32_t* packed_vector);
         int* memory_block_;
         int64_t memory_size_;
         AliasTableIndex* table_index_;
-
-        std::vector<int32_t> height_;
-        std::vector<float> mass_;
+        /*!
+         * \brief position of each word in table_index_, so the hot path
+         *  needs neither a search nor an existence check
+         */
+        std::vector<int32_t> position_;
+        /*! \brief handles of the words of the slice, by position */
+        std::vector<WordHandle> handles_;
         int32_t beta_height_;
         float beta_mass_;
 
@@ -74,16 +146,35 @@ namespace multiverso { namespace lightlda
         _THREAD_LOCAL static std::vector<int>* q_w_proportion_int_;
         _THREAD_LOCAL static std::vector<std::pair<int, int>>* L_;
         _THREAD_LOCAL static std::vector<std::pair<int, int>>* H_;
+        _THREAD_LOCAL static std::vector<int>* kv_;
 
         int num_vocabs_;
         int num_topics_;
         float beta_;
         float beta_sum_;
+        bool compact_;
 
         // No copying allowed
         AliasTable(const AliasTable&);
         void operator=(const AliasTable&);
     };
+
+    inline const WordHandle& AliasTable::handle(int32_t word) const
+    {
+        return handles_[position_[word]];
+    }
+    inline void AliasTable::PrefetchPosition(int32_t word) const
+    {
+        LIGHTLDA_PREFETCH(&position_[word]);
+    }
+    inline void AliasTable::PrefetchHandle(int32_t word) const
+    {
+        LIGHTLDA_PREFETCH(&handles_[position_[word]]);
+    }
+    inline void AliasTable::PrefetchAliasRow(int32_t word) const
+    {
+        LIGHTLDA_PREFETCH(handles_[position_[word]].alias_row);
+    }
 } // namespace lightlda
 } // namespace multiverso
 #endif // LIGHTLDA_ALIAS_TABLE_H_
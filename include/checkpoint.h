@@ -0,0 +1,188 @@
+/*!
+ * \file checkpoint.h
+ * \brief Defines the binary sharded checkpoint of the model and topics
+ */
+
+#ifndef LIGHTLDA_CHECKPOINT_H_
+#define LIGHTLDA_CHECKPOINT_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <multiverso/row.h>
+
+namespace multiverso { namespace lightlda
+{
+    class DataBlock;
+    class Meta;
+
+    /*! \brief Description of a checkpoint, stored in its manifest file */
+    struct CheckpointManifest
+    {
+        /*! \brief iteration after which the checkpoint was taken */
+        int32_t iteration;
+        int32_t num_vocabs;
+        int32_t num_topics;
+        int32_t num_blocks;
+        /*! \brief number of word-topic shards and doc-topic parts */
+        int32_t num_shards;
+        /*! \brief whether doc_topic files are present */
+        bool has_doc_topic;
+        /*! \brief number of rows of each word-topic shard */
+        std::vector<int64_t> shard_rows;
+    };
+
+    /*!
+     * \brief CheckpointQueue runs checkpoint writes on a background thread.
+     *  Trainers only copy rows and topics into snapshot buffers and go on
+     *  sampling, the writes of the snapshots run in the order pushed
+     */
+    class CheckpointQueue
+    {
+    public:
+        typedef std::function<void()> Task;
+
+        /*! \brief Starts the writer thread if checkpoints are enabled */
+        static void Start();
+        /*!
+         * \brief Queues task holding a snapshot of bytes, blocks while the
+         *  queued snapshots exceed the memory budget. Runs task in place if
+         *  the writer thread is not started
+         */
+        static void Push(const Task& task, int64_t bytes);
+        /*! \brief Waits for all queued writes and stops the writer thread */
+        static void Close();
+    private:
+        static void WriterMain();
+
+        static std::mutex mutex_;
+        static std::condition_variable cond_;
+        static std::deque<std::pair<Task, int64_t>> tasks_;
+        static int64_t pending_bytes_;
+        static bool stop_;
+        static std::thread thread_;
+    };
+
+    /*!
+     * \brief CheckpointWriter writes one word-topic shard. A row is stored
+     *  as int32 word, int32 size and size pairs of int32 topic, count.
+     *  Full buffers are written through CheckpointQueue
+     */
+    class CheckpointWriter
+    {
+    public:
+        CheckpointWriter();
+        /*! \brief Creates <dir>/word_topic.<shard> */
+        void Open(const std::string& dir, int32_t shard);
+        /*! \brief Appends the non-zero entries of row */
+        void WriteRow(int32_t word, Row<int32_t>& row);
+        /*! \brief Flushes and closes the shard, Fatal on I/O errors */
+        void Close();
+        bool is_open() const { return file_ != nullptr; }
+        int64_t num_rows() const { return num_rows_; }
+    private:
+        void Flush();
+
+        /*! \brief shared with the queued writes, which may outlive Close */
+        std::shared_ptr<std::ofstream> file_;
+        std::string file_name_;
+        std::vector<int32_t> buffer_;
+        int64_t num_rows_;
+    };
+
+    /*!
+     * \brief Checkpoint defines the layout of a checkpoint directory:
+     *  manifest                  text description, written last
+     *  word_topic.<shard>        rows written by one trainer thread
+     *  summary                   int64 count of each topic
+     *  doc_topic.<block>.<part>  int64 number of tokens and int32 topic of
+     *                            each token, of a contiguous range of docs
+     *  Every word is written by the last block containing it, so rows are
+     *  taken after their final update in the iteration
+     */
+    class Checkpoint
+    {
+    public:
+        /*! \brief Visits a row, pairs holds size (topic, count) pairs */
+        typedef std::function<void(int32_t word, const int32_t* pairs,
+            int32_t size)> RowVisitor;
+
+        /*! \brief Assigns words to blocks, should call after Meta::Init */
+        static void Init(const Meta& meta);
+        /*! \brief Whether a checkpoint is written after iteration */
+        static bool IsDue(int32_t iteration);
+        /*! \brief Directory of the checkpoint after iteration */
+        static std::string Directory(int32_t iteration);
+        /*!
+         * \brief Directory to resume from, -resume_dir with the same rank
+         *  suffix as Directory if there are several processes
+         */
+        static std::string ResumeDirectory();
+        /*! \brief Whether the row of word is written with block */
+        static bool OwnsWord(int32_t block, int32_t word);
+        /*! \brief Range of docs [begin, end) of a doc-topic part */
+        static void PartRange(int32_t num_docs, int32_t part,
+            int32_t num_parts, int32_t& begin, int32_t& end);
+
+        static void CreateDirectory(const std::string& dir);
+        /*!
+         * \brief Snapshots the topics of [doc_begin, doc_end) of a block,
+         *  the file is written by CheckpointQueue
+         */
+        static void WriteDocTopics(const std::string& dir, int32_t block,
+            int32_t part, DataBlock& data, int32_t doc_begin, int32_t doc_end);
+        static void WriteSummary(const std::string& dir, Row<int64_t>& row);
+        /*! \brief Queued after the other files, so it is written last */
+        static void WriteManifest(const std::string& dir,
+            const CheckpointManifest& manifest);
+
+        /*! \brief Whether dir holds a complete checkpoint */
+        static bool Exists(const std::string& dir);
+        static void ReadManifest(const std::string& dir,
+            CheckpointManifest& manifest);
+        /*!
+         * \brief Reads all word-topic shards, one thread per shard. Rows
+         *  of a word are in one shard, so visitor is called concurrently
+         *  only for different words
+         */
+        static void ReadWordTopic(const std::string& dir,
+            const CheckpointManifest& manifest, const RowVisitor& visitor);
+        /*!
+         * \brief Reads all word-topic shards, one thread per shard, into
+         *  shards. Each holds rows of word, size, topic1, count1, ...
+         */
+        static void ReadWordTopicShards(const std::string& dir,
+            const CheckpointManifest& manifest,
+            std::vector<std::vector<int32_t>>& shards);
+        /*! \brief Calls visitor on each row of a shard */
+        static void VisitShard(const std::vector<int32_t>& shard,
+            const RowVisitor& visitor);
+        static void ReadSummary(const std::string& dir,
+            const CheckpointManifest& manifest, std::vector<int64_t>& summary);
+        /*! \brief Restores the topics of a block, one thread per part */
+        static void ReadDocTopics(const std::string& dir,
+            const CheckpointManifest& manifest, int32_t block, DataBlock& data);
+    private:
+        /*! \brief Reads a word-topic shard and checks its rows */
+        static void ReadShard(const std::string& dir,
+            const CheckpointManifest& manifest, int32_t shard,
+            std::vector<int32_t>& buffer);
+        static void WriteManifestFile(const std::string& dir,
+            const CheckpointManifest& manifest);
+
+        /*! \brief last block containing each word */
+        static std::vector<int32_t> owner_block_;
+    };
+} // namespace lightlda
+} // namespace multiverso
+
+#endif // LIGHTLDA_CHECKPOINT_H_
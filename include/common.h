@@ -22,6 +22,8 @@ namespace multiverso { namespace lightlda
     const int32_t kLoadFactor = 2;
     /*! \brief max length of a document */
     const int32_t kMaxDocLength = 8192;
+    /*! \brief number of alias build stages per slice when pipelined */
+    const int32_t kAliasPipelineStages = 4;
     
     typedef int64_t DocNumber;
 
@@ -41,6 +43,8 @@ namespace multiverso { namespace lightlda
         static int32_t num_iterations;
         /*! \brief number of metropolis-hastings steps */
         static int32_t mh_steps;
+        /*! \brief tokens ahead whose rows are prefetched by sampler, 0 off */
+        static int32_t prefetch_tokens;
         /*! \brief number of servers for Multiverso setting */
         static int32_t num_servers;
         /*! \brief server endpoint file */
@@ -49,6 +53,11 @@ namespace multiverso { namespace lightlda
         static int32_t num_local_workers;
         /*! \brief number of local aggregation threads */
         static int32_t num_aggregator;
+        /*! 
+         * \brief number of worker threads building alias for the next
+         *  stage of a slice while the others sample, 0 to disable
+         */
+        static int32_t alias_builders;
         /*! \brief number of blocks to train in disk */
         static int32_t num_blocks;
         /*! \brief maximum number of documents in a block */
@@ -65,6 +74,30 @@ namespace multiverso { namespace lightlda
         static bool inference;
         /*! \brief option specity whether use out of core computation */
         static bool out_of_core;
+        /*! \brief option specify whether map data blocks into memory */
+        static bool mmap_data;
+        /*! \brief option specify whether write back topics to side files only */
+        static bool topic_file;
+        /*! \brief engine for block file I/O, stream or direct */
+        static std::string io_engine;
+        /*! \brief number of block buffers of out of core data stream */
+        static int32_t prefetch_buffers;
+        /*! \brief max number of blocks read ahead of training, 0 for all */
+        static int32_t prefetch_depth;
+        /*! \brief directory of binary checkpoints, empty to disable */
+        static std::string checkpoint_dir;
+        /*! \brief iterations between checkpoints, 0 for the last one only */
+        static int32_t checkpoint_interval;
+        /*! \brief option specify whether checkpoints hold doc topics */
+        static bool checkpoint_doc_topic;
+        /*! \brief checkpoint directory to resume training from */
+        static std::string resume_dir;
+        /*! \brief iterations between refreshes of resident rows, 0 never */
+        static int32_t model_refresh_interval;
+        /*! \brief path of JSON lines file for training metrics */
+        static std::string metrics_file;
+        /*! \brief path of chrome://tracing JSON file for timeline events */
+        static std::string trace_file;
         /*! \brief memory capacity settings, for memory pools */
         static int64_t data_capacity;
         static int64_t model_capacity;
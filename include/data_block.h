@@ -7,6 +7,7 @@
 #define LIGHTLDA_DATA_BLOCK_H_
 
 #include "common.h"
+#include "document.h"
 
 #include <multiverso/multiverso.h>
 
@@ -17,7 +18,6 @@
 
 namespace multiverso { namespace lightlda
 {
-    class Document;
     class LocalVocab;
 	
     /*!
@@ -27,7 +27,12 @@ namespace multiverso { namespace lightlda
     class DataBlock
     {
     public:
-        DataBlock();
+        /*!
+         * \brief Constructs a data block
+         * \param write_back whether topics are written back to the block
+         *  file, decides MAP_SHARED or MAP_PRIVATE when Config::mmap_data
+         */
+        explicit DataBlock(bool write_back = false);
         ~DataBlock();
         /*! \brief Reads a block of data into data block from disk */
         void Read(dump* dmp);
@@ -43,22 +48,43 @@ namespace multiverso { namespace lightlda
         /*!
          * \brief Gets one document
          * \param index index of document
-         * \return pointer to document
+         * \return view of document, valid until the block is reloaded
          */
-        Document* GetOneDoc(int32_t index);
+        Document GetOneDoc(int32_t index);
 
         // mutator and accessor methods
         const LocalVocab& meta() const;
         void set_meta(const LocalVocab* local_vocab);
     private:
-        void GenerateDocuments();
+        /*! \brief Allocates memory pools of -data_capacity */
+        void AllocateBuffers();
+        /*! \brief Maps the block file, buffers point into the mapping */
+        void MapFile();
+        /*! \brief Releases the mapping of block file, if any */
+        void Unmap();
+        /*! \brief Points buffers into an image of block file and checks it */
+        void ParseImage(void* image, int64_t size);
+        /*! \brief Overwrites topics with the side file of block, if exists */
+        void ReadTopics();
+        /*! \brief Writes only topics of block to its side file */
+        void WriteTopics();
         bool has_read_;
+        /*! \brief whether topics are written back to the block file */
+        bool write_back_;
+        /*! \brief whether block files are memory mapped */
+        bool use_mmap_;
+        /*! \brief address and size of the mapped block file */
+        void* mapped_;
+        int64_t mapped_size_;
+        /*! \brief whether block files are read and written with O_DIRECT */
+        bool use_direct_;
+        /*! \brief aligned memory holding a whole block file for direct I/O */
+        void* image_;
+        int64_t image_capacity_;
         /*! \brief size of memory pool for document offset */
         int64_t max_num_document_;
         /*! \brief size of memory pool for documents */
         int64_t memory_block_size_;
-        /*! \brief index to each document */
-        std::vector<std::shared_ptr<Document>> documents_;
         /*! \brief number of document in this block */
         DocNumber num_document_;
         /*! \brief memory pool to store the document offset */
@@ -92,6 +118,8 @@ namespace multiverso { namespace lightlda
         void set_iteration(int32_t iteration);
         DataBlock& data();
         void set_data(DataBlock* data);
+        /*! \brief words whose rows ParamLoader requested for this slice */
+        std::vector<int32_t>& refreshed_words();
     private:
         /*! \brief the actual data block */
         DataBlock* data_;
@@ -101,14 +129,16 @@ namespace multiverso { namespace lightlda
         int32_t slice_;
         /*! \brief the i-th iteration */
         int32_t iteration_;
+        std::vector<int32_t> refreshed_words_;
     };
 
     // -- inline functions definition area --------------------------------- //
 
     inline bool DataBlock::HasLoad() const { return has_read_; }
-    inline Document* DataBlock::GetOneDoc(int32_t index)
+    inline Document DataBlock::GetOneDoc(int32_t index)
     { 
-        return documents_[index].get(); 
+        return Document(documents_buffer_ + offset_buffer_[index],
+            documents_buffer_ + offset_buffer_[index + 1]);
     }
     inline const LocalVocab& DataBlock::meta() const  { return *vocab_; }
     inline void DataBlock::set_meta(const LocalVocab* local_vocab)
@@ -127,6 +157,10 @@ namespace multiverso { namespace lightlda
 
     inline DataBlock& LDADataBlock::data() { return *data_; }
     inline void LDADataBlock::set_data(DataBlock* data) { data_ = data; }
+    inline std::vector<int32_t>& LDADataBlock::refreshed_words()
+    {
+        return refreshed_words_;
+    }
     inline DocNumber DataBlock::Size() const { return num_document_; }
 
     // -- inline functions definition area --------------------------------- //
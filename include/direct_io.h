@@ -0,0 +1,51 @@
+/*!
+ * \file direct_io.h
+ * \brief Defines whole file reads and writes bypassing the page cache
+ */
+
+#ifndef LIGHTLDA_DIRECT_IO_H_
+#define LIGHTLDA_DIRECT_IO_H_
+
+#include <cstdint>
+#include <string>
+
+namespace multiverso { namespace lightlda
+{
+    /*!
+     * \brief DirectIO transfers a whole file between disk and an aligned
+     *  memory image with O_DIRECT, issuing large chunks from several
+     *  threads in parallel. Files on file systems without O_DIRECT support
+     *  are accessed with the same parallel reads and writes, and dropped
+     *  from the page cache afterwards.
+     */
+    class DirectIO
+    {
+    public:
+        /*! \brief alignment of buffers, sizes and offsets */
+        static const int64_t kAlignment = 4096;
+        /*! \brief Rounds size up to a multiple of kAlignment */
+        static int64_t Align(int64_t size);
+        /*! \brief Allocates an aligned buffer of Align(size) bytes */
+        static void* Allocate(int64_t size);
+        /*! \brief Frees a buffer returned by Allocate */
+        static void Free(void* buffer);
+        /*!
+         * \brief Reads the whole file into buffer
+         * \param file_name file to read
+         * \param buffer aligned buffer from Allocate
+         * \param capacity size of buffer, Fatal if the file is larger
+         * \return size of the file in bytes
+         */
+        static int64_t ReadFile(const std::string& file_name, void* buffer,
+            int64_t capacity);
+        /*!
+         * \brief Writes size bytes of buffer as the whole file. The buffer
+         *  should be at least Align(size) bytes
+         */
+        static void WriteFile(const std::string& file_name,
+            const void* buffer, int64_t size);
+    };
+} // namespace lightlda
+} // namespace multiverso
+
+#endif // LIGHTLDA_DIRECT_IO_H_
@@ -0,0 +1,96 @@
+/*!
+ * \file metrics.h
+ * \brief Defines training telemetry exported as JSON lines
+ */
+
+#ifndef LIGHTLDA_METRICS_H_
+#define LIGHTLDA_METRICS_H_
+
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <vector>
+
+namespace multiverso { namespace lightlda
+{
+    /*! \brief Statistics of one trainer thread on one slice */
+    struct ThreadStats
+    {
+        /*! \brief number of sampled tokens */
+        int64_t num_tokens;
+        /*! \brief time spent on building alias rows */
+        double alias_seconds;
+        /*! \brief time spent on sampling documents */
+        double sampling_seconds;
+        /*! \brief time spent on waiting other threads */
+        double barrier_seconds;
+        /*! \brief number of word proposals different from current state */
+        int64_t word_proposals;
+        /*! \brief number of accepted word proposals */
+        int64_t word_accepts;
+        /*! \brief number of doc proposals different from current state */
+        int64_t doc_proposals;
+        /*! \brief number of accepted doc proposals */
+        int64_t doc_accepts;
+        /*! \brief number of tokens whose topic changed */
+        int64_t topic_changes;
+    };
+
+    /*! \brief Kinds of likelihood reported by Trainer::Evaluate */
+    enum class Likelihood { Doc = 0, Word = 1, Normalized = 2 };
+
+    /*!
+     * \brief Metrics collects statistics of every (iteration, block, slice)
+     *  from all trainer threads, and appends one JSON object per slice to
+     *  Config::metrics_file. Metrics is disabled if the file is not set.
+     */
+    class Metrics
+    {
+    public:
+        /*! \brief Opens the metrics file, should call after Config::Init */
+        static void Init(int32_t rank);
+        /*! \brief Closes the metrics file */
+        static void Close();
+        /*! \brief Whether metrics is enabled */
+        static bool Enabled();
+        /*!
+         * \brief Records the likelihood of the current slice
+         * \param type kind of likelihood
+         * \param value likelihood value
+         */
+        static void RecordLikelihood(Likelihood type, double value);
+        /*!
+         * \brief Records the time training waited for a data block, which
+         *  is reported with the next slice
+         * \param seconds stall time
+         */
+        static void RecordIOStall(double seconds);
+        /*!
+         * \brief Commits the statistics of one thread on a slice. The last
+         *  thread of the slice writes the record
+         * \param iteration iteration id
+         * \param block block id
+         * \param slice slice id
+         * \param thread_id trainer id
+         * \param num_threads number of trainers
+         * \param stats statistics of this thread
+         */
+        static void Commit(int32_t iteration, int32_t block, int32_t slice,
+            int32_t thread_id, int32_t num_threads, const ThreadStats& stats);
+    private:
+        static void WriteRecord(int32_t iteration, int32_t block,
+            int32_t slice);
+
+        static FILE* file_;
+        static int32_t rank_;
+        static std::mutex mutex_;
+        static std::vector<ThreadStats> thread_stats_;
+        static int32_t num_committed_;
+        static double likelihood_[3];
+        static bool has_likelihood_[3];
+        static double io_stall_seconds_;
+    };
+} // namespace lightlda
+} // namespace multiverso
+
+#endif // LIGHTLDA_METRICS_H_
@@ -50,12 +50,19 @@ namespace lightlda
             int32_t delta) override;
         void AddSummaryRow(integer_t topic_id, int64_t delta) override;
         void ClearTable();
+        /*!
+         * \brief Allocates the row of a word, dense or sparse based on 
+         *  the term frequency of the word
+         */
+        void InitWordTopicRow(integer_t word_id, int32_t tf);
 
     private:
         void CreateTable();
         void LoadTable();
         void LoadWordTopicTable(const std::string& model_fname);
         void LoadSummaryTable(const std::string& model_fname);
+        /*! \brief Loads a binary checkpoint, one thread per shard */
+        void LoadCheckpoint(const std::string& dir);
 
         std::unique_ptr<Table> word_topic_table_;
         std::unique_ptr<Table> summary_table_;
@@ -0,0 +1,70 @@
+/*!
+ * \file row_cache.h
+ * \brief Defines the policy of keeping word-topic rows resident in a
+ *  lightlda-owned store across iterations
+ */
+
+#ifndef LIGHTLDA_ROW_CACHE_H_
+#define LIGHTLDA_ROW_CACHE_H_
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace multiverso
+{
+    template<typename T> class Row;
+    class Table;
+
+namespace lightlda
+{
+    class Meta;
+
+    /*!
+     * \brief RowCache decides which rows ParamLoader requests from servers.
+     *  If the rows of all local words fit -model_capacity together, they
+     *  are kept in a store owned by RowCache rather than in the multiverso
+     *  cache, which may drop rows that are not requested. A row fetched
+     *  from servers is copied into the store, the local deltas are applied
+     *  to the store as well, and the row is requested again only once it
+     *  is -model_refresh_interval iterations old
+     */
+    class RowCache
+    {
+    public:
+        /*! \brief Decides whether rows stay resident, call after Meta::Init */
+        static void Init(const Meta& meta);
+        /*!
+         * \brief Whether the row of word should be requested in iteration,
+         *  and if so tags the row as fetched. Not thread safe
+         */
+        static bool NeedRefresh(int32_t word, int32_t iteration);
+        /*!
+         * \brief Replaces the stored row of word by the row fetched from
+         *  servers. Rows of different words may be refreshed concurrently
+         */
+        static void Refresh(int32_t word, Row<int32_t>& fetched);
+        /*! \brief Stored row of word, only valid if resident */
+        static Row<int32_t>& GetRow(int32_t word);
+        /*!
+         * \brief Adds delta to the stored row of word. Concurrent adds to
+         *  a row are serialized, reads are not locked
+         */
+        static void Add(int32_t word, int32_t topic, int32_t delta);
+        /*! \brief Whether rows stay resident across iterations */
+        static bool resident() { return resident_; }
+    private:
+        static bool resident_;
+        /*! \brief iteration each row was fetched in, INT32_MIN if never */
+        static std::vector<int32_t> version_;
+        /*! \brief resident rows of the local words */
+        static std::unique_ptr<Table> table_;
+        /*! \brief locks of the rows, striped by word */
+        static const int32_t kNumLocks = 1024;
+        static std::mutex locks_[kNumLocks];
+    };
+} // namespace lightlda
+} // namespace multiverso
+
+#endif // LIGHTLDA_ROW_CACHE_H_
@@ -0,0 +1,160 @@
+/*!
+ * \file text_parser.h
+ * \brief Defines allocation-free scanning and integer parsing of text
+ *  inputs, shared by the preprocessing tools and the model loaders
+ */
+
+#ifndef LIGHTLDA_TEXT_PARSER_H_
+#define LIGHTLDA_TEXT_PARSER_H_
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define LIGHTLDA_TEXT_PARSER_SSE2
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+namespace multiverso { namespace lightlda
+{
+    /*! \brief Non-owning view of the chars in [begin, end) */
+    struct TextView
+    {
+        const char* begin;
+        const char* end;
+
+        TextView() : begin(nullptr), end(nullptr) {}
+        TextView(const char* begin, const char* end) : begin(begin), end(end) {}
+        explicit TextView(const std::string& str)
+            : begin(str.data()), end(str.data() + str.size()) {}
+
+        size_t size() const { return end - begin; }
+        bool empty() const { return begin == end; }
+        std::string ToString() const { return std::string(begin, end); }
+    };
+
+    /*!
+     * \brief TextParser scans delimiters 16 bytes at a time with SSE2 where
+     *  available and decodes decimal integers in place, so lines are split
+     *  into fields and numbers without allocating a string per field
+     */
+    class TextParser
+    {
+    public:
+        /*! \brief Returns the first c in [begin, end), or end if not found */
+        static const char* Find(const char* begin, const char* end, char c);
+        /*! \brief Strips trailing spaces and '\r' */
+        static TextView TrimRight(TextView text);
+        /*! \brief Skips spaces and tabs from ptr */
+        static const char* SkipSpaces(const char* ptr, const char* end);
+        /*!
+         * \brief Splits text at separator, fields are views into text
+         * \param fields receives up to max_fields fields
+         * \return number of fields in text, which may exceed max_fields.
+         *  An empty text has no field
+         */
+        static int32_t Split(TextView text, char separator,
+            TextView* fields, int32_t max_fields);
+        /*!
+         * \brief Decodes a non-negative decimal int32 starting at ptr and
+         *  advances ptr past its digits
+         * \return false if there are no digits or the value overflows
+         */
+        static bool ParseInt(const char*& ptr, const char* end, int32_t& value);
+        /*! \brief Decodes a field that should be exactly one int32 */
+        static bool ParseInt(TextView text, int32_t& value);
+    };
+
+    inline const char* TextParser::Find(const char* begin, const char* end,
+        char c)
+    {
+#ifdef LIGHTLDA_TEXT_PARSER_SSE2
+        const __m128i pattern = _mm_set1_epi8(c);
+        for (; end - begin >= 16; begin += 16)
+        {
+            __m128i chunk = _mm_loadu_si128(
+                reinterpret_cast<const __m128i*>(begin));
+            int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, pattern));
+            if (mask != 0)
+            {
+#ifdef _MSC_VER
+                unsigned long index;
+                _BitScanForward(&index, mask);
+                return begin + index;
+#else
+                return begin + __builtin_ctz(mask);
+#endif
+            }
+        }
+#endif
+        while (begin < end && *begin != c) ++begin;
+        return begin;
+    }
+
+    inline TextView TextParser::TrimRight(TextView text)
+    {
+        while (text.end > text.begin &&
+            (text.end[-1] == ' ' || text.end[-1] == '\r'))
+        {
+            --text.end;
+        }
+        return text;
+    }
+
+    inline const char* TextParser::SkipSpaces(const char* ptr,
+        const char* end)
+    {
+        while (ptr < end && (*ptr == ' ' || *ptr == '\t')) ++ptr;
+        return ptr;
+    }
+
+    inline int32_t TextParser::Split(TextView text, char separator,
+        TextView* fields, int32_t max_fields)
+    {
+        if (text.empty()) return 0;
+        int32_t num_fields = 0;
+        while (true)
+        {
+            const char* pos = Find(text.begin, text.end, separator);
+            if (num_fields < max_fields)
+            {
+                fields[num_fields] = TextView(text.begin, pos);
+            }
+            ++num_fields;
+            if (pos == text.end) return num_fields;
+            text.begin = pos + 1;
+        }
+    }
+
+    inline bool TextParser::ParseInt(const char*& ptr, const char* end,
+        int32_t& value)
+    {
+        const char* p = ptr;
+        uint64_t result = 0;
+        for (; p < end; ++p)
+        {
+            uint32_t digit = static_cast<unsigned char>(*p) - '0';
+            if (digit > 9) break;
+            result = result * 10 + digit;
+        }
+        // more than 10 digits may wrap around result
+        if (p == ptr || p - ptr > 10 || result > INT32_MAX) return false;
+        value = static_cast<int32_t>(result);
+        ptr = p;
+        return true;
+    }
+
+    inline bool TextParser::ParseInt(TextView text, int32_t& value)
+    {
+        const char* ptr = text.begin;
+        return ParseInt(ptr, text.end, value) && ptr == text.end;
+    }
+} // namespace lightlda
+} // namespace multiverso
+
+#endif // LIGHTLDA_TEXT_PARSER_H_
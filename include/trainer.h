@@ -6,10 +6,16 @@
 #ifndef LIGHTLDA_TRAINER_H_
 #define LIGHTLDA_TRAINER_H_
 
+#include <atomic>
 #include <mutex>
+#include <vector>
+
+#include "checkpoint.h"
+#include "common.h"
 
 #include <multiverso/multiverso.h>
 #include <multiverso/barrier.h>
+#include <multiverso/stop_watch.h>
 
 namespace multiverso { namespace lightlda
 {
@@ -36,9 +42,31 @@ namespace multiverso { namespace lightlda
          */
         void Evaluate(LDADataBlock* block);
 
-        void Dump(int32_t iter, LDADataBlock* lda_data_block);
-
     private:
+        /*! \brief Waits on barrier and accounts the wait time of this thread */
+        bool Wait();
+        /*! \brief Builds alias rows of words in [begin, end), strided by thread */
+        void BuildAlias(const int32_t* begin, const int32_t* end,
+            int32_t id, int32_t num_threads);
+        /*!
+         * \brief Trains a slice with Config::alias_builders threads building 
+         *  the alias of the next stage while the other threads sample
+         * \return number of sampled tokens of this thread
+         */
+        int32_t PipelinedTrain(LDADataBlock* lda_data_block, StopWatch& watch);
+        /*!
+         * \brief Writes the rows owned by this slice to the shard of this
+         *  thread, and the doc topics, summary and manifest once the
+         *  block or iteration is complete
+         */
+        void WriteCheckpoint(LDADataBlock* lda_data_block);
+        /*!
+         * \brief Logs the predicted and actual time of a slice, should only
+         *  be called by thread 0
+         * \param cost predicted cost of the slice by Meta
+         */
+        void LogSliceTime(double cost, double seconds);
+
         /*! \brief alias table, for alias access */
         AliasTable* alias_;
         /*! \brief sampler for lightlda */
@@ -49,10 +77,18 @@ namespace multiverso { namespace lightlda
         Meta* meta_;
         /*! \brief model acceccor */
         PSModel * model_;
+        /*! \brief word-topic shard of this thread in the current checkpoint */
+        CheckpointWriter checkpoint_;
         static std::mutex mutex_;
 
         static double doc_llh_;
         static double word_llh_;
+        /*! \brief number of builders that finished each pipeline stage */
+        static std::atomic<int32_t> alias_stage_done_[kAliasPipelineStages];
+        /*! \brief number of rows in the checkpoint shard of each thread */
+        static std::vector<int64_t> checkpoint_rows_;
+        /*! \brief calibrated time of a unit of predicted slice cost */
+        static double seconds_per_cost_;
     };
 
     /*! 
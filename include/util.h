@@ -18,6 +18,12 @@ namespace multiverso { namespace lightlda
         {
             jxr_ = static_cast<unsigned int>(time(nullptr));
         }
+        /*! \brief seeds explicitly, e.g. to decorrelate threads */
+        explicit xorshift_rng(uint32_t seed)
+        {
+            // xorshift gets stuck at zero
+            jxr_ = seed == 0 ? 1 : seed;
+        }
         ~xorshift_rng() {}
 
         /*! \brief get random (xorshift) 32-bit integer*/
@@ -117,16 +117,16 @@ namespace multiverso { namespace lightlda
             {
                 for (int32_t i = 0; i < data_block.Size(); ++i)
                 {
-                    Document* doc = data_block.GetOneDoc(i);
-                    int32_t& cursor = doc->Cursor();
+                    Document doc = data_block.GetOneDoc(i);
+                    int32_t& cursor = doc.Cursor();
                     if (slice == 0) cursor = 0;
                     int32_t last_word = meta.local_vocab(block).LastWord(slice);
-                    for (; cursor < doc->Size(); ++cursor)
+                    for (; cursor < doc.Size(); ++cursor)
                     {
-                        if (doc->Word(cursor) > last_word) break;
+                        if (doc.Word(cursor) > last_word) break;
                         // Init the latent variable
                         if (!Config::warm_start)
-                            doc->SetTopic(cursor, rng.rand_k(Config::num_topics));
+                            doc.SetTopic(cursor, rng.rand_k(Config::num_topics));
                     }
                 }
             }
@@ -145,9 +145,9 @@ namespace multiverso { namespace lightlda
             DataBlock& data_block = data_stream->CurrDataBlock();
             for (int i = 0; i < data_block.Size(); ++i)
             {
-                Document* doc = data_block.GetOneDoc(i);
+                Document doc = data_block.GetOneDoc(i);
                 doc_topic_counter.Clear();
-                doc->GetDocTopicVector(doc_topic_counter);
+                doc.GetDocTopicVector(doc_topic_counter);
                 Row<int32_t>::iterator iter = doc_topic_counter.Iterator();
                 while (iter.HasNext())
                 {
@@ -78,8 +78,8 @@ namespace multiverso { namespace lightlda
         // Inference with lightlda sampler
         for (int32_t doc_id = id_; doc_id < data.Size(); doc_id += thread_num_)
         {
-            Document* doc = data.GetOneDoc(doc_id);
-            sampler_->SampleOneDoc(doc, 0, lastword, model_, alias_);
+            Document doc = data.GetOneDoc(doc_id);
+            sampler_->SampleOneDoc(&doc, 0, lastword, model_, alias_);
         }
     }
 
@@ -2,7 +2,8 @@
  * \file dump_binary.cpp
  * \brief Preprocessing tool for converting LibSVM data to LightLDA input binary format
  *  Usage: 
- *    dump_binary <libsvm_input> <word_dict_file_input> <binary_output_dir> <output_file_offset>
+ *    dump_binary <libsvm_input> <word_dict_file_input> <binary_output_dir> <output_file_offset> [num_threads] [options]
+ *    run without arguments for options
  */
 
 #include <algorithm>
@@ -10,11 +11,18 @@
 #include <cstdint>
 #include <cstring>
 #include <fstream>
+#include <functional>
 #include <iostream>
+#include <random>
 #include <string>
+#include <thread>
 #include <unordered_map>
 #include <vector>
 
+#include "../src/text_parser.h"
+
+using multiverso::lightlda::TextParser;
+using multiverso::lightlda::TextView;
 
 namespace lightlda
 {
@@ -195,7 +203,7 @@ namespace lightlda
 
     bool utf8_stream::getline(std::string& line)
     {
-        line = "";
+        line.clear();
         while (true)
         {
             if (block_is_empty())
@@ -212,18 +220,20 @@ namespace lightlda
             }
             // the block is not empty now
 
-            std::string::size_type end_pos = block_buf_.find("\n", buf_idx_);
-            if (end_pos != std::string::npos)
+            const char* buffer = block_buf_.data();
+            std::string::size_type end_pos = TextParser::Find(
+                buffer + buf_idx_, buffer + buf_end_, '\n') - buffer;
+            if (end_pos != buf_end_)
             {
                 // successfully find a new line
-                line += block_buf_.substr(buf_idx_, end_pos - buf_idx_);
+                line.append(block_buf_, buf_idx_, end_pos - buf_idx_);
                 buf_idx_ = end_pos + 1;
                 return true;
             }
             else
             {
                 // do not find an \n untile the end of block_buf_
-                line += block_buf_.substr(buf_idx_, buf_end_ - buf_idx_);
+                line.append(block_buf_, buf_idx_, buf_end_ - buf_idx_);
                 buf_idx_ = buf_end_;
             }
         }
@@ -285,72 +295,6 @@ double get_time()
     return std::chrono::duration_cast<std::chrono::duration<double, std::ratio<1, 1>>>(since_epoch).count();
 }
 
-void split_string(std::string& line, char separator, std::vector<std::string>& output, bool trimEmpty = false)
-{
-    output.clear();
-
-    if (line.empty())
-    {
-        return;
-    }
-
-    // trip whitespace, \r
-    while (!line.empty())
-    {
-        int32_t last = line.length() - 1;
-        if (line[last] == ' ' || line[last] == '\r')
-        {
-            line.erase(last, 1);
-        }
-        else
-        {
-            break;
-        }
-    }
-
-    std::string::size_type pos;
-    std::string::size_type lastPos = 0;
-
-    using value_type = std::vector<std::string>::value_type;
-    using size_type = std::vector<std::string>::size_type;
-
-    while (true)
-    {
-        pos = line.find_first_of(separator, lastPos);
-        if (pos == std::string::npos)
-        {
-            pos = line.length();
-
-            if (pos != lastPos || !trimEmpty)
-                output.push_back(value_type(line.data() + lastPos,
-                (size_type)pos - lastPos));
-
-            break;
-        }
-        else
-        {
-            if (pos != lastPos || !trimEmpty)
-                output.push_back(value_type(line.data() + lastPos,
-                (size_type)pos - lastPos));
-        }
-
-        lastPos = pos + 1;
-    }
-    return;
-}
-
-void count_doc_num(std::string input_doc, int64_t &doc_num)
-{
-    lightlda::utf8_stream stream;
-    if (!stream.open(input_doc))
-    {
-        std::cout << "Fails to open file: " << input_doc << std::endl;
-        exit(1);
-    }
-    doc_num = stream.count_line();
-    stream.close();
-}
-
 void load_global_tf(std::unordered_map<int32_t, int32_t>& global_tf_map,
     std::string word_tf_file,
     int64_t& global_tf_count)
@@ -364,15 +308,15 @@ void load_global_tf(std::unordered_map<int32_t, int32_t>& global_tf_map,
     std::string line;
     while (stream.getline(line))
     {
-        std::vector<std::string> output;
-        split_string(line, '\t', output);
-        if (output.size() != 3)
+        TextView fields[3];
+        int32_t word_id, tf;
+        if (TextParser::Split(TextParser::TrimRight(TextView(line)), '\t',
+            fields, 3) != 3 || !TextParser::ParseInt(fields[0], word_id) ||
+            !TextParser::ParseInt(fields[2], tf))
         {
             std::cout << "Invalid line: " << line << std::endl;
             exit(1);
         }
-        int32_t word_id = std::stoi(output[0]);
-        int32_t tf = std::stoi(output[2]);
         auto it = global_tf_map.find(word_id);
         if (it != global_tf_map.end())
         {
@@ -385,155 +329,296 @@ void load_global_tf(std::unordered_map<int32_t, int32_t>& global_tf_map,
     stream.close();
 }
 
-int main(int argc, char* argv[])
+/*!
+ * \brief Renumbers words by descending global tf, ties by original id, so
+ *  that hot words get small and contiguous ids. The mapping only depends
+ *  on the dict, so separate runs for different blocks agree. Writes
+ *  <output_dir>/word_id.remap as new_id TAB old_id TAB word TAB tf, and
+ *  rewrites global_tf_map to new ids
+ * \param remap set to the new id of each original id
+ */
+void build_remap(std::string word_tf_file, std::string output_dir,
+    std::unordered_map<int32_t, int32_t>& global_tf_map,
+    std::vector<int32_t>& remap)
 {
-    if (argc != 5)
+    int32_t word_num = global_tf_map.size();
+    std::vector<std::string> words(word_num);
+    lightlda::utf8_stream stream;
+    if (!stream.open(word_tf_file))
     {
-        printf("Usage: dump_binary <libsvm_input> <word_dict_file_input> <binary_output_dir> <output_file_offset>\n");
+        std::cout << "Fails to open file: " << word_tf_file << std::endl;
         exit(1);
     }
+    std::string line;
+    while (stream.getline(line))
+    {
+        TextView fields[3];
+        int32_t word_id = -1;
+        TextParser::Split(TextParser::TrimRight(TextView(line)), '\t',
+            fields, 3);
+        TextParser::ParseInt(fields[0], word_id);
+        if (word_id < 0 || word_id >= word_num)
+        {
+            std::cout << "Word ids of dict should be 0 to " << word_num - 1
+                << " for remapping: " << line << std::endl;
+            exit(1);
+        }
+        words[word_id] = fields[1].ToString();
+    }
+    stream.close();
 
-    std::string libsvm_file_name(argv[1]);
-    std::string word_dict_file_name(argv[2]);
-    std::string output_dir(argv[3]);
-    int32_t output_offset = atoi(argv[4]);
-    const int32_t kMaxDocLength = 8192;
-
-    // 1. count how many documents in the data set
-    int64_t doc_num;
-    count_doc_num(libsvm_file_name, doc_num);
-
-    // 2. load the word_dict file, get the global {word_id, tf} mapping
-    std::unordered_map<int32_t, int32_t> global_tf_map;
-    std::unordered_map<int32_t, int32_t> local_tf_map;
-    int64_t global_tf_count = 0;
-    load_global_tf(global_tf_map, word_dict_file_name, global_tf_count);
-    int32_t word_num = global_tf_map.size();
-    std::cout << "There are totally " << word_num 
-			<< " words in the vocabulary" << std::endl;
-    std::cout << "There are maximally totally " << global_tf_count 
-			<< " tokens in the data set" << std::endl;
-
-    // 3. transform the libsvm -> binary block
-    int64_t* offset_buf = new int64_t[doc_num + 1];
-    int32_t *doc_buf = new int32_t[kMaxDocLength * 2 + 1];
-
-    std::string block_name = output_dir + "/block." + std::to_string(output_offset);
-    std::string vocab_name = output_dir + "/vocab." + std::to_string(output_offset);
-    std::string txt_vocab_name = output_dir + "/vocab." + std::to_string(output_offset) + ".txt";
-
-    // open file
-    lightlda::utf8_stream libsvm_file;
-    lightlda::block_stream block_file;
+    std::vector<int32_t> order(word_num);
+    for (int32_t i = 0; i < word_num; ++i) order[i] = i;
+    std::sort(order.begin(), order.end(), [&](int32_t a, int32_t b)
+    {
+        int32_t tf_a = global_tf_map[a], tf_b = global_tf_map[b];
+        return tf_a > tf_b || (tf_a == tf_b && a < b);
+    });
 
-    if (!libsvm_file.open(libsvm_file_name))
+    std::string remap_name = output_dir + "/word_id.remap";
+    std::ofstream remap_file(remap_name, std::ios::out);
+    if (!remap_file.good())
     {
-        std::cout << "Fails to open file: " << libsvm_file_name << std::endl;
+        std::cout << "Fails to create file: " << remap_name << std::endl;
         exit(1);
     }
-    if (!block_file.open(block_name))
+    std::unordered_map<int32_t, int32_t> remapped_tf_map;
+    remap.resize(word_num);
+    for (int32_t new_id = 0; new_id < word_num; ++new_id)
     {
-        std::cout << "Fails to create file: " << block_name << std::endl;
-        exit(1);
+        int32_t old_id = order[new_id];
+        remap[old_id] = new_id;
+        remapped_tf_map[new_id] = global_tf_map[old_id];
+        remap_file << new_id << "\t" << old_id << "\t" << words[old_id]
+            << "\t" << global_tf_map[old_id] << "\n";
     }
-    std::ofstream vocab_file(vocab_name, std::ios::out | std::ios::binary);
-    std::ofstream txt_vocab_file(txt_vocab_name, std::ios::out);
+    remap_file.close();
+    global_tf_map.swap(remapped_tf_map);
+}
 
-    if (!vocab_file.good())
+/*!
+ * \brief Loads the mapping of an earlier build_remap from remap_name, so
+ *  that appended blocks number words the same way as existing ones, and
+ *  rewrites global_tf_map to new ids
+ */
+void load_remap(const std::string& remap_name,
+    std::unordered_map<int32_t, int32_t>& global_tf_map,
+    std::vector<int32_t>& remap)
+{
+    int32_t word_num = global_tf_map.size();
+    lightlda::utf8_stream stream;
+    if (!stream.open(remap_name))
     {
-        std::cout << "Fails to create file: " << vocab_name << std::endl;
+        std::cout << "Fails to open file: " << remap_name << std::endl;
         exit(1);
     }
-    if (!txt_vocab_file.good())
+    remap.assign(word_num, -1);
+    std::string line;
+    while (stream.getline(line))
     {
-        std::cout << "Fails to create file: " << txt_vocab_name << std::endl;
-        exit(1);
+        TextView fields[2];
+        int32_t new_id, old_id;
+        if (TextParser::Split(TextView(line), '\t', fields, 2) < 2 ||
+            !TextParser::ParseInt(fields[0], new_id) ||
+            !TextParser::ParseInt(fields[1], old_id))
+        {
+            std::cout << "Invalid line: " << line << std::endl;
+            exit(1);
+        }
+        if (old_id < word_num && new_id < word_num) remap[old_id] = new_id;
     }
+    stream.close();
 
-    block_file.write_empty_header(offset_buf, doc_num);
-
-    int64_t block_token_num = 0;
-    std::string str_line;
-    std::string line;
-    char *endptr = nullptr;
-    const int kBASE = 10;
-    int doc_buf_idx;
-
-    double dump_start = get_time();
-
-    offset_buf[0] = 0;
-    for (int64_t j = 0; j < doc_num; ++j)
+    std::unordered_map<int32_t, int32_t> remapped_tf_map;
+    for (int32_t old_id = 0; old_id < word_num; ++old_id)
     {
-        if (!libsvm_file.getline(str_line) || str_line.empty())
+        if (remap[old_id] == -1)
         {
-            std::cout << "Fails to get line" << std::endl;
+            std::cout << "Word " << old_id << " of dict is not in " << remap_name
+                << ", convert all documents again to remap a grown vocabulary"
+                << std::endl;
             exit(1);
         }
-        str_line += '\n';
-
-        std::vector<std::string> output;
-        split_string(str_line, '\t', output);
+        remapped_tf_map[remap[old_id]] = global_tf_map[old_id];
+    }
+    global_tf_map.swap(remapped_tf_map);
+}
 
+const int32_t kMaxDocLength = 8192;
 
-        if (output.size() != 2)
+/*! \brief Documents parsed from a range of lines, in the block format */
+struct parsed_docs
+{
+    // cursor, word1, topic1, ..., wordn, topicn of each doc
+    std::vector<int32_t> buffer;
+    // length of each doc in buffer
+    std::vector<int32_t> sizes;
+    // dense term frequency, indexed by word id, kept across chunks
+    std::vector<int32_t> local_tf;
+    // word ids with a nonzero local_tf
+    std::vector<int32_t> touched;
+    int64_t token_num = 0;
+
+    /*! \brief Clears the docs, zeroing only the touched entries of local_tf */
+    void reset(int32_t word_num)
+    {
+        buffer.clear();
+        sizes.clear();
+        if (local_tf.size() != static_cast<size_t>(word_num))
         {
-            std::cout << "Invalid format, not key TAB val: " << str_line << std::endl;
-            exit(1);
+            local_tf.assign(word_num, 0);
+        }
+        else
+        {
+            for (auto word_id : touched) local_tf[word_id] = 0;
         }
+        touched.clear();
+        token_num = 0;
+    }
+};
 
-        int doc_token_count = 0;
-        std::vector<Token> doc_tokens;
+void invalid_line(const char* reason, const char* begin, const char* end)
+{
+    std::cout << reason << std::string(begin, end) << std::endl;
+    exit(1);
+}
 
-        char *ptr = &(output[1][0]);
+/*!
+ * \brief Parses the libsvm lines in [begin, end), each ends with '\n',
+ *  into documents with words sorted by id
+ */
+void parse_lines(const char* begin, const char* end, int32_t word_num,
+    const int32_t* remap, parsed_docs& docs)
+{
+    docs.reset(word_num);
+    std::vector<int32_t> words;
+    for (const char* line = begin; line < end;)
+    {
+        const char* next_line = TextParser::Find(line, end, '\n') + 1;
+        const char* line_end = TextParser::TrimRight(
+            TextView(line, next_line - 1)).end;
+        if (line_end == line)
+        {
+            std::cout << "Fails to get line" << std::endl;
+            exit(1);
+        }
+        const char* ptr = TextParser::Find(line, line_end, '\t');
+        if (ptr == line_end || TextParser::Find(ptr + 1, line_end, '\t') != line_end)
+        {
+            invalid_line("Invalid format, not key TAB val: ", line, line_end);
+        }
+        ++ptr;
+        while (ptr < line_end && *ptr == ' ') ++ptr;
 
-        while (*ptr != '\n')
+        words.clear();
+        while (ptr < line_end && words.size() < kMaxDocLength)
         {
-            if (doc_token_count >= kMaxDocLength) break;
             // read a word_id:count pair
-            int32_t word_id = strtol(ptr, &endptr, kBASE);
-            ptr = endptr;
-            if (':' != *ptr)
+            int32_t word_id, count;
+            if (!TextParser::ParseInt(ptr, line_end, word_id) ||
+                ptr == line_end || *ptr != ':' ||
+                !TextParser::ParseInt(++ptr, line_end, count))
             {
-                std::cout << "Invalid input" << str_line << std::endl;
-                exit(1);
+                invalid_line("Invalid input", line, line_end);
             }
-            int32_t count = strtol(++ptr, &endptr, kBASE);
-
-            ptr = endptr;
-            for (int k = 0; k < count; ++k)
+            if (word_id >= word_num)
             {
-                doc_tokens.push_back({ word_id, 0 });
-                if (local_tf_map.find(word_id) == local_tf_map.end())
-                {
-                    local_tf_map.insert(std::make_pair(word_id, 1));
-                }
-                else
-                {
-                    local_tf_map[word_id]++;
-                }
-                ++block_token_num;
-                ++doc_token_count;
-                if (doc_token_count >= kMaxDocLength) break;
+                invalid_line("Word id out of vocabulary: ", line, line_end);
+            }
+            if (remap != nullptr) word_id = remap[word_id];
+            count = std::min(count,
+                kMaxDocLength - static_cast<int32_t>(words.size()));
+            words.insert(words.end(), count, word_id);
+            if (count > 0 && docs.local_tf[word_id] == 0)
+            {
+                docs.touched.push_back(word_id);
             }
-            while (*ptr == ' ' || *ptr == '\r') ++ptr;
+            docs.local_tf[word_id] += count;
+            while (ptr < line_end && *ptr == ' ') ++ptr;
         }
         // The input data may be already sorted
-        std::sort(doc_tokens.begin(), doc_tokens.end(), Compare);
+        if (!std::is_sorted(words.begin(), words.end()))
+        {
+            std::sort(words.begin(), words.end());
+        }
 
-        doc_buf_idx = 0;
-        doc_buf[doc_buf_idx++] = 0; // cursor
+        docs.buffer.push_back(0); // cursor
+        for (auto word : words)
+        {
+            docs.buffer.push_back(word);
+            docs.buffer.push_back(0);
+        }
+        docs.sizes.push_back(static_cast<int32_t>(words.size()) * 2 + 1);
+        docs.token_num += words.size();
+        line = next_line;
+    }
+}
 
-        for (auto& token : doc_tokens)
+/*!
+ * \brief Parses [begin, end) on num_threads threads, each takes a range
+ *  split at newline boundaries. parts is reused across calls, so that its
+ *  tf arrays are allocated once
+ */
+void parse_chunk(const char* begin, const char* end, int32_t word_num,
+    const int32_t* remap, int32_t num_threads, std::vector<parsed_docs>& parts)
+{
+    parts.resize(num_threads);
+    std::vector<std::thread> threads;
+    const char* range_begin = begin;
+    for (int32_t i = 0; i < num_threads && range_begin < end; ++i)
+    {
+        const char* range_end = end;
+        if (i != num_threads - 1)
         {
-            doc_buf[doc_buf_idx++] = token.word_id;
-            doc_buf[doc_buf_idx++] = token.topic_id;
+            range_end = range_begin + (end - range_begin) / (num_threads - i);
+            range_end = TextParser::Find(range_end, end, '\n') + 1;
         }
+        threads.emplace_back(parse_lines, range_begin, range_end, word_num, remap,
+            std::ref(parts[i]));
+        range_begin = range_end;
+    }
+    for (auto& thread : threads) thread.join();
+    for (size_t i = threads.size(); i < parts.size(); ++i)
+    {
+        parts[i].reset(word_num);
+    }
+}
 
-        block_file.write_doc(doc_buf, doc_buf_idx);
-        offset_buf[j + 1] = offset_buf[j] + doc_buf_idx;
+/*! \brief Adds term frequency of num_docs docs starting at doc_buf */
+void count_tf(const int32_t* doc_buf, const int32_t* sizes, size_t num_docs,
+    std::vector<int32_t>& local_tf)
+{
+    for (size_t i = 0; i < num_docs; ++i)
+    {
+        for (int32_t j = 1; j < sizes[i]; j += 2)
+        {
+            ++local_tf[doc_buf[j]];
+        }
+        doc_buf += sizes[i];
     }
-    block_file.write_real_header(offset_buf, doc_num);
+}
+
+/*! \brief Writes vocab.<block_id> and vocab.<block_id>.txt of one block */
+void write_vocab(const std::string& output_dir, int32_t block_id,
+    const std::vector<int32_t>& local_tf,
+    std::unordered_map<int32_t, int32_t>& global_tf_map)
+{
+    std::string vocab_name = output_dir + "/vocab." + std::to_string(block_id);
+    std::string txt_vocab_name = vocab_name + ".txt";
+    std::ofstream vocab_file(vocab_name, std::ios::out | std::ios::binary);
+    std::ofstream txt_vocab_file(txt_vocab_name, std::ios::out);
 
+    if (!vocab_file.good())
+    {
+        std::cout << "Fails to create file: " << vocab_name << std::endl;
+        exit(1);
+    }
+    if (!txt_vocab_file.good())
+    {
+        std::cout << "Fails to create file: " << txt_vocab_name << std::endl;
+        exit(1);
+    }
+    int32_t word_num = static_cast<int32_t>(local_tf.size());
     int32_t vocab_size = 0;
 
     vocab_file.write(reinterpret_cast<char*>(&vocab_size), sizeof(int32_t));
@@ -542,19 +627,18 @@ int main(int argc, char* argv[])
     // write vocab
     for (int i = 0; i < word_num; ++i)
     {
-        if (local_tf_map[i] > 0)
+        if (local_tf[i] > 0)
         {
             non_zero_count++;
             vocab_file.write(reinterpret_cast<char*> (&i), sizeof(int32_t));
         }
     }
-    std::cout << "The number of tokens in the output block is: " << block_token_num << std::endl;
     std::cout << "Local vocab_size for the output block is: " << non_zero_count << std::endl;
 
     // write global tf
     for (int i = 0; i < word_num; ++i)
     {
-        if (local_tf_map[i] > 0)
+        if (local_tf[i] > 0)
         {
             vocab_file.write(reinterpret_cast<char*> (&global_tf_map[i]), sizeof(int32_t));
         }
@@ -562,9 +646,9 @@ int main(int argc, char* argv[])
     // write local tf
     for (int i = 0; i < word_num; ++i)
     {
-        if (local_tf_map[i] > 0)
+        if (local_tf[i] > 0)
         {
-            vocab_file.write(reinterpret_cast<char*> (&local_tf_map[i]), sizeof(int32_t));
+            vocab_file.write(reinterpret_cast<const char*> (&local_tf[i]), sizeof(int32_t));
         }
     }
     vocab_file.seekp(0);
@@ -574,21 +658,503 @@ int main(int argc, char* argv[])
     txt_vocab_file << non_zero_count << std::endl;
     for (int i = 0; i < word_num; ++i)
     {
-        if (local_tf_map[i] > 0)
+        if (local_tf[i] > 0)
         {
-            txt_vocab_file << i << "\t" << global_tf_map[i] << "\t" << local_tf_map[i] << std::endl;
+            txt_vocab_file << i << "\t" << global_tf_map[i] << "\t" << local_tf[i] << std::endl;
         }
     }
     txt_vocab_file.close();
+}
+
+/*! \brief Reads word ids and local tf of vocab.<block_id> */
+void read_vocab(const std::string& output_dir, int32_t block_id,
+    std::vector<int32_t>& words, std::vector<int32_t>& global_tf,
+    std::vector<int32_t>& local_tf)
+{
+    std::string vocab_name = output_dir + "/vocab." + std::to_string(block_id);
+    std::ifstream vocab_file(vocab_name, std::ios::in | std::ios::binary);
+    int32_t vocab_size = 0;
+    vocab_file.read(reinterpret_cast<char*>(&vocab_size), sizeof(int32_t));
+    words.resize(vocab_size);
+    global_tf.resize(vocab_size);
+    local_tf.resize(vocab_size);
+    vocab_file.read(reinterpret_cast<char*>(words.data()), sizeof(int32_t) * vocab_size);
+    vocab_file.read(reinterpret_cast<char*>(global_tf.data()), sizeof(int32_t) * vocab_size);
+    vocab_file.read(reinterpret_cast<char*>(local_tf.data()), sizeof(int32_t) * vocab_size);
+    if (!vocab_file.good())
+    {
+        std::cout << "Fails to read file: " << vocab_name << std::endl;
+        exit(1);
+    }
+}
+
+/*!
+ * \brief Overwrites the global tf of vocab.<block_id> in place, and
+ *  regenerates vocab.<block_id>.txt
+ */
+void update_global_tf(const std::string& output_dir, int32_t block_id,
+    std::unordered_map<int32_t, int32_t>& global_tf_map)
+{
+    std::vector<int32_t> words, global_tf, local_tf;
+    read_vocab(output_dir, block_id, words, global_tf, local_tf);
+    int32_t vocab_size = static_cast<int32_t>(words.size());
+    for (int32_t i = 0; i < vocab_size; ++i)
+    {
+        global_tf[i] = global_tf_map[words[i]];
+    }
+
+    std::string vocab_name = output_dir + "/vocab." + std::to_string(block_id);
+    std::fstream vocab_file(vocab_name,
+        std::ios::in | std::ios::out | std::ios::binary);
+    vocab_file.seekp(sizeof(int32_t) * (1 + vocab_size));
+    vocab_file.write(reinterpret_cast<char*>(global_tf.data()), sizeof(int32_t) * vocab_size);
+    if (!vocab_file.good())
+    {
+        std::cout << "Fails to update file: " << vocab_name << std::endl;
+        exit(1);
+    }
+    vocab_file.close();
+
+    std::ofstream txt_vocab_file(vocab_name + ".txt", std::ios::out);
+    txt_vocab_file << vocab_size << std::endl;
+    for (int32_t i = 0; i < vocab_size; ++i)
+    {
+        txt_vocab_file << words[i] << "\t" << global_tf[i] << "\t" << local_tf[i] << std::endl;
+    }
+    txt_vocab_file.close();
+}
+
+/*! \brief Number of consecutive block.N files in output_dir from block.0 */
+int32_t count_blocks(const std::string& output_dir)
+{
+    int32_t num_blocks = 0;
+    while (std::ifstream(output_dir + "/block." + std::to_string(num_blocks)).good())
+    {
+        ++num_blocks;
+    }
+    return num_blocks;
+}
+
+/*! \brief Reads the number of docs and int32s of block.<block_id> */
+void read_block_size(const std::string& output_dir, int32_t block_id,
+    int64_t& doc_num, int64_t& int32_num)
+{
+    std::string block_name = output_dir + "/block." + std::to_string(block_id);
+    std::ifstream block_file(block_name, std::ios::in | std::ios::binary);
+    block_file.read(reinterpret_cast<char*>(&doc_num), sizeof(int64_t));
+    block_file.seekg(sizeof(int64_t) * (doc_num + 1));
+    block_file.read(reinterpret_cast<char*>(&int32_num), sizeof(int64_t));
+    if (!block_file.good())
+    {
+        std::cout << "Fails to read file: " << block_name << std::endl;
+        exit(1);
+    }
+}
+
+/*! \brief Size limits of output blocks, 0 for unlimited */
+struct block_limits
+{
+    int64_t docs = 0;
+    int64_t tokens = 0;
+    int64_t bytes = 0;
+
+    bool enabled() const { return docs > 0 || tokens > 0 || bytes > 0; }
+    /*! \brief Whether a block of the given size is within the limits */
+    bool fit(int64_t doc_num, int64_t token_num) const
+    {
+        return (docs <= 0 || doc_num <= docs) &&
+            (tokens <= 0 || token_num <= tokens) &&
+            (bytes <= 0 || block_bytes(doc_num, token_num) <= bytes);
+    }
+    /*! \brief Number of blocks needed by the given total size */
+    int64_t num_blocks(int64_t doc_num, int64_t token_num) const
+    {
+        int64_t num = 1;
+        if (docs > 0) num = std::max(num, (doc_num + docs - 1) / docs);
+        if (tokens > 0) num = std::max(num, (token_num + tokens - 1) / tokens);
+        if (bytes > 0)
+        {
+            int64_t size = block_bytes(doc_num, token_num);
+            num = std::max(num, (size + bytes - 1) / bytes);
+        }
+        return num;
+    }
+    /*! \brief Size of a block file with doc_num docs and token_num tokens */
+    static int64_t block_bytes(int64_t doc_num, int64_t token_num)
+    {
+        return sizeof(int64_t)* (doc_num + 2) +
+            sizeof(int32_t)* (doc_num + 2 * token_num);
+    }
+};
+
+/*! \brief Parses sizes like 512M, suffixes K, M, G are powers of 1024 */
+int64_t parse_size(const char* str)
+{
+    char* end = nullptr;
+    int64_t size = strtoll(str, &end, 10);
+    switch (*end)
+    {
+    case 'G': case 'g': size *= 1024; // fall through
+    case 'M': case 'm': size *= 1024; // fall through
+    case 'K': case 'k': size *= 1024; // fall through
+    default: break;
+    }
+    return size;
+}
+
+/*!
+ * \brief Collects documents of one output block, and writes block.N and
+ *  its vocab once complete
+ */
+struct block_builder
+{
+    std::vector<int64_t> offset_buf;
+    std::vector<int32_t> doc_buf;
+    std::vector<int32_t> local_tf;
+    int64_t token_num = 0;
+
+    int64_t doc_num() const { return offset_buf.size() - 1; }
+
+    void reset(int32_t word_num)
+    {
+        offset_buf.assign(1, 0);
+        doc_buf.clear();
+        local_tf.assign(word_num, 0);
+        token_num = 0;
+    }
+
+    /*! \brief Draws the topic of each token uniformly from [0, num_topics) */
+    void init_topics(int32_t num_topics, uint32_t seed)
+    {
+        std::mt19937 rng(seed);
+        for (int64_t i = 0; i < doc_num(); ++i)
+        {
+            for (int64_t pos = offset_buf[i] + 2; pos < offset_buf[i + 1]; pos += 2)
+            {
+                doc_buf[pos] = static_cast<int32_t>(rng() % num_topics);
+            }
+        }
+    }
+
+    void write(const std::string& output_dir, int32_t block_id,
+        std::unordered_map<int32_t, int32_t>& global_tf_map)
+    {
+        std::string block_name = output_dir + "/block." + std::to_string(block_id);
+        lightlda::block_stream block_file;
+        if (!block_file.open(block_name))
+        {
+            std::cout << "Fails to create file: " << block_name << std::endl;
+            exit(1);
+        }
+        // offsets are known by now, so the block is written in one pass
+        block_file.write_empty_header(offset_buf.data(), doc_num());
+        for (int64_t i = 0; i < doc_num(); ++i)
+        {
+            block_file.write_doc(doc_buf.data() + offset_buf[i],
+                static_cast<int32_t>(offset_buf[i + 1] - offset_buf[i]));
+        }
+        block_file.write_real_header(offset_buf.data(), doc_num());
+        block_file.close();
+
+        std::cout << "Block " << block_id << ": " << doc_num()
+            << " documents, " << token_num << " tokens" << std::endl;
+        write_vocab(output_dir, block_id, local_tf, global_tf_map);
+    }
+};
+
+void print_usage()
+{
+    printf("Usage: dump_binary <libsvm_input> <word_dict_file_input> <binary_output_dir> <output_file_offset> [num_threads] [options]\n");
+    printf("-num_threads <arg>       Number of parsing threads. Default: number of cores\n");
+    printf("-block_docs <arg>        Max number of documents per block\n");
+    printf("-block_tokens <arg>      Max number of tokens per block\n");
+    printf("-block_bytes <arg>       Max size of block file, e.g. 512M or 2G\n");
+    printf("-remap_vocab             Renumber words by descending tf, the mapping is\n");
+    printf("                         written to <binary_output_dir>/word_id.remap\n");
+    printf("-append                  Add blocks after the existing block.* of\n");
+    printf("                         <binary_output_dir>, numbered from the first free\n");
+    printf("                         index, and update global tf of all vocab.*.\n");
+    printf("                         Reuses word_id.remap of the existing blocks\n");
+    printf("-num_topics <arg>        Draw topics of the output tokens at random, so\n");
+    printf("                         that lightlda -warm_start can train them\n");
+    printf("Without block limits, all documents go to block.<output_file_offset>.\n");
+    printf("Otherwise blocks are numbered from <output_file_offset> and tokens\n");
+    printf("are balanced across them.\n");
+    exit(1);
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 5)
+    {
+        print_usage();
+    }
+
+    std::string libsvm_file_name(argv[1]);
+    std::string word_dict_file_name(argv[2]);
+    std::string output_dir(argv[3]);
+    int32_t output_offset = atoi(argv[4]);
+    int32_t num_threads = static_cast<int32_t>(std::thread::hardware_concurrency());
+    block_limits limits;
+    bool remap_vocab = false;
+    bool append = false;
+    int32_t num_topics = 0;
+    for (int i = 5; i < argc; ++i)
+    {
+        if (argv[i][0] != '-')
+        {
+            if (i != 5) print_usage();
+            num_threads = atoi(argv[i]);
+            continue;
+        }
+        if (strcmp(argv[i], "-remap_vocab") == 0)
+        {
+            remap_vocab = true;
+            continue;
+        }
+        if (strcmp(argv[i], "-append") == 0)
+        {
+            append = true;
+            continue;
+        }
+        if (i + 1 == argc) print_usage();
+        if (strcmp(argv[i], "-num_threads") == 0) num_threads = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "-block_docs") == 0) limits.docs = atoll(argv[i + 1]);
+        else if (strcmp(argv[i], "-block_tokens") == 0) limits.tokens = atoll(argv[i + 1]);
+        else if (strcmp(argv[i], "-block_bytes") == 0) limits.bytes = parse_size(argv[i + 1]);
+        else if (strcmp(argv[i], "-num_topics") == 0) num_topics = atoi(argv[i + 1]);
+        else print_usage();
+        ++i;
+    }
+    num_threads = std::max(num_threads, 1);
+    // bytes of input parsed by each thread at a time
+    const int64_t kChunkSize = 16 * 1024 * 1024;
+    const int64_t kMB = 1024 * 1024;
+
+    // 1. load the word_dict file, get the global {word_id, tf} mapping
+    std::unordered_map<int32_t, int32_t> global_tf_map;
+    int64_t global_tf_count = 0;
+    load_global_tf(global_tf_map, word_dict_file_name, global_tf_count);
+    int32_t word_num = global_tf_map.size();
+    std::cout << "There are totally " << word_num 
+			<< " words in the vocabulary" << std::endl;
+    std::cout << "There are maximally totally " << global_tf_count 
+			<< " tokens in the data set" << std::endl;
+    if (append)
+    {
+        int32_t existing_blocks = count_blocks(output_dir);
+        if (existing_blocks != output_offset)
+        {
+            std::cout << "Appending after " << existing_blocks
+                << " existing blocks, from block." << existing_blocks << std::endl;
+        }
+        output_offset = existing_blocks;
+    }
+    std::vector<int32_t> remap;
+    std::string remap_name = output_dir + "/word_id.remap";
+    if (append && output_offset > 0 && std::ifstream(remap_name).good())
+    {
+        load_remap(remap_name, global_tf_map, remap);
+    }
+    else if (append && output_offset > 0 && remap_vocab)
+    {
+        std::cout << "Existing blocks are not remapped, -remap_vocab needs "
+            << "converting all documents again" << std::endl;
+        exit(1);
+    }
+    else if (remap_vocab)
+    {
+        build_remap(word_dict_file_name, output_dir, global_tf_map, remap);
+    }
+
+    std::ifstream libsvm_file(libsvm_file_name, std::ios::in | std::ios::binary);
+    if (!libsvm_file.good())
+    {
+        std::cout << "Fails to open file: " << libsvm_file_name << std::endl;
+        exit(1);
+    }
+    libsvm_file.seekg(0, std::ios::end);
+    int64_t input_size = libsvm_file.tellg();
+    libsvm_file.seekg(0, std::ios::beg);
+
+    double dump_start = get_time();
+
+    // 2. transform the libsvm -> blocks, reading the input only once.
+    // Chunks are cut at the last newline, the rest is carried over.
+    std::vector<char> chunk(kChunkSize * num_threads);
+    // per thread docs, reused over the chunks
+    std::vector<parsed_docs> parts;
+    block_builder block;
+    block.reset(word_num);
+    int32_t block_id = output_offset;
+    int64_t input_parsed = 0, doc_parsed = 0, token_parsed = 0;
+    int64_t doc_written = 0, token_written = 0;
+    int64_t max_doc_num = 0, max_int32_num = 0;
+    int64_t carry = 0;
+    // close the current block once it holds target_tokens
+    int64_t target_tokens = 0;
+    auto flush_block = [&]()
+    {
+        if (num_topics > 0) block.init_topics(num_topics, block_id);
+        block.write(output_dir, block_id++, global_tf_map);
+        max_doc_num = std::max(max_doc_num, block.doc_num());
+        max_int32_num = std::max(max_int32_num, block.offset_buf.back());
+        doc_written += block.doc_num();
+        token_written += block.token_num;
+        block.reset(word_num);
+    };
+    while (true)
+    {
+        libsvm_file.read(chunk.data() + carry, chunk.size() - carry);
+        int64_t size = carry + libsvm_file.gcount();
+        if (size == 0) break;
+        bool eof = libsvm_file.gcount() == 0;
+        int64_t end = size;
+        while (end > 0 && chunk[end - 1] != '\n') --end;
+        if (eof)
+        {
+            // the last line has no \n
+            chunk.resize(size + 1);
+            chunk[size] = '\n';
+            end = size + 1;
+        }
+        else if (end == 0)
+        {
+            // a line longer than the chunk
+            carry = size;
+            chunk.resize(chunk.size() * 2);
+            continue;
+        }
+
+        parse_chunk(chunk.data(), chunk.data() + end, word_num,
+            remap.empty() ? nullptr : remap.data(), num_threads,
+            parts);
+        input_parsed += end;
+        for (auto& part : parts)
+        {
+            doc_parsed += part.sizes.size();
+            token_parsed += part.token_num;
+        }
+        if (limits.enabled())
+        {
+            // balance the rest of the input, as estimated from the parsed
+            // part, evenly over the blocks it needs
+            double scale = input_parsed >= input_size ? 1.0
+                : static_cast<double>(input_size) / input_parsed;
+            int64_t doc_left = static_cast<int64_t>(doc_parsed * scale) - doc_written;
+            int64_t token_left = static_cast<int64_t>(token_parsed * scale) - token_written;
+            int64_t blocks_left = limits.num_blocks(doc_left, token_left);
+            target_tokens = (token_left + blocks_left - 1) / blocks_left;
+        }
+
+        for (auto& part : parts)
+        {
+            const int32_t* doc_buf = part.buffer.data();
+            // docs of this part in the current block start from first
+            size_t first = 0;
+            const int32_t* first_buf = doc_buf;
+            for (size_t i = 0; i < part.sizes.size(); ++i)
+            {
+                int32_t doc_tokens = part.sizes[i] / 2;
+                if (limits.enabled() && block.doc_num() > 0 &&
+                    (block.token_num >= target_tokens ||
+                    !limits.fit(block.doc_num() + 1, block.token_num + doc_tokens)))
+                {
+                    count_tf(first_buf, part.sizes.data() + first, i - first,
+                        block.local_tf);
+                    flush_block();
+                    first = i;
+                    first_buf = doc_buf;
+                }
+                block.doc_buf.insert(block.doc_buf.end(), doc_buf,
+                    doc_buf + part.sizes[i]);
+                block.offset_buf.push_back(block.offset_buf.back() + part.sizes[i]);
+                block.token_num += doc_tokens;
+                doc_buf += part.sizes[i];
+            }
+            if (first == 0)
+            {
+                // the whole part is in one block, use its counts
+                for (auto word_id : part.touched)
+                {
+                    block.local_tf[word_id] += part.local_tf[word_id];
+                }
+            }
+            else
+            {
+                count_tf(first_buf, part.sizes.data() + first,
+                    part.sizes.size() - first, block.local_tf);
+            }
+        }
+        carry = eof ? 0 : size - end;
+        memmove(chunk.data(), chunk.data() + end, carry);
+    }
+    if (block.doc_num() > 0 || block_id == output_offset)
+    {
+        flush_block();
+    }
+
+    int32_t num_blocks = block_id - output_offset;
+    std::cout << "There are " << doc_written << " documents in " << num_blocks
+        << " blocks" << std::endl;
+    std::cout << "The number of tokens in the output blocks is: " << token_written << std::endl;
+    if (append && output_offset > 0)
+    {
+        // the dict may not count the appended documents yet, so global tf
+        // is raised to the tokens of each word over all blocks
+        std::vector<int64_t> total_tf(word_num, 0);
+        std::vector<int32_t> words, global_tf, local_tf;
+        for (int32_t id = 0; id < block_id; ++id)
+        {
+            read_vocab(output_dir, id, words, global_tf, local_tf);
+            for (size_t i = 0; i < words.size(); ++i)
+            {
+                if (words[i] < 0 || words[i] >= word_num)
+                {
+                    std::cout << "Word " << words[i] << " of vocab." << id
+                        << " is not in the dict" << std::endl;
+                    exit(1);
+                }
+                total_tf[words[i]] += local_tf[i];
+            }
+        }
+        int32_t raised_num = 0;
+        for (int32_t w = 0; w < word_num; ++w)
+        {
+            if (total_tf[w] > global_tf_map[w])
+            {
+                global_tf_map[w] = static_cast<int32_t>(total_tf[w]);
+                ++raised_num;
+            }
+        }
+        if (raised_num > 0)
+        {
+            std::cout << "Global tf of " << raised_num << " words is raised to "
+                << "their count in the blocks" << std::endl;
+        }
+        for (int32_t id = 0; id < block_id; ++id)
+        {
+            update_global_tf(output_dir, id, global_tf_map);
+        }
+        for (int32_t id = 0; id < output_offset; ++id)
+        {
+            int64_t doc_num = 0, int32_num = 0;
+            read_block_size(output_dir, id, doc_num, int32_num);
+            max_doc_num = std::max(max_doc_num, doc_num);
+            max_int32_num = std::max(max_int32_num, int32_num);
+        }
+        num_blocks = block_id;
+        std::cout << "The block set has " << num_blocks << " blocks" << std::endl;
+    }
+    std::cout << "Recommended flags: -num_vocabs " << word_num
+        << " -num_blocks " << num_blocks
+        << " -max_num_document " << max_doc_num + 1
+        << " -data_capacity " << max_int32_num * sizeof(int32_t) / kMB + 1
+        << std::endl;
 
     double dump_end = get_time();
     std::cout << "Elapsed seconds for dump blocks: " << (dump_end - dump_start) << std::endl;
 
-    // close file and release resource
     libsvm_file.close();
-    block_file.close();
-
-    delete[]offset_buf;
-    delete[]doc_buf;
     return 0;
 }
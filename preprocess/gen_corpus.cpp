@@ -0,0 +1,395 @@
+/*!
+ * \file gen_corpus.cpp
+ * \brief Generates a synthetic corpus from the LDA generative process, in
+ *  the LightLDA input binary format (block.N, vocab.N) plus word_id.dict
+ *  Usage:
+ *    gen_corpus -output_dir <dir> [options], run with -help for options
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace lightlda
+{
+    /*! \brief Options of the generator */
+    struct corpus_config
+    {
+        int32_t num_vocabs = 100000;
+        int32_t num_topics = 1000;
+        int64_t num_docs = 100000;
+        int32_t num_blocks = 1;
+        int32_t doc_length = 200;
+        std::string length_dist = "poisson";
+        int32_t topic_words = 0;
+        double alpha = 0.1;
+        double zipf = 1.0;
+        uint64_t seed = 1;
+        std::string output_dir = "";
+    };
+
+    /*!
+     * \brief Topic-word distribution. To bound the memory by
+     *  num_topics * topic_words, every topic is a distribution over a
+     *  support of words drawn from the global Zipfian base distribution.
+     *  A word drawn n times gets weight n * Gamma(1), so the expected
+     *  marginal stays Zipfian while topics differ from each other
+     */
+    class topic_distribution
+    {
+    public:
+        void init(const std::vector<double>& zipf_cdf, int32_t support,
+            std::mt19937_64& rng)
+        {
+            std::uniform_real_distribution<double> uniform(0.0, 1.0);
+            std::gamma_distribution<double> gamma(1.0, 1.0);
+            words_.resize(support);
+            for (auto& word : words_)
+            {
+                word = static_cast<int32_t>(std::lower_bound(zipf_cdf.begin(),
+                    zipf_cdf.end(), uniform(rng)) - zipf_cdf.begin());
+                word = std::min(word, static_cast<int32_t>(zipf_cdf.size()) - 1);
+            }
+            std::sort(words_.begin(), words_.end());
+            std::vector<double> weights;
+            size_t size = 0;
+            for (size_t i = 0; i < words_.size(); ++i)
+            {
+                if (i == 0 || words_[i] != words_[size - 1])
+                {
+                    words_[size++] = words_[i];
+                    weights.push_back(0.0);
+                }
+                weights.back() += gamma(rng);
+            }
+            words_.resize(size);
+            cdf_.resize(size);
+            double sum = 0.0;
+            for (size_t i = 0; i < size; ++i)
+            {
+                sum += weights[i];
+                cdf_[i] = static_cast<float>(sum);
+            }
+            for (auto& p : cdf_) p = static_cast<float>(p / sum);
+        }
+        int32_t sample(std::mt19937_64& rng) const
+        {
+            std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+            size_t idx = std::lower_bound(cdf_.begin(), cdf_.end(),
+                uniform(rng)) - cdf_.begin();
+            return words_[std::min(idx, words_.size() - 1)];
+        }
+    private:
+        std::vector<int32_t> words_;
+        std::vector<float> cdf_;
+    };
+
+    struct Token
+    {
+        int32_t word_id;
+        int32_t topic_id;
+    };
+
+    bool compare(const Token& token1, const Token& token2)
+    {
+        return token1.word_id < token2.word_id;
+    }
+
+    class corpus_generator
+    {
+    public:
+        explicit corpus_generator(const corpus_config& config)
+            : config_(config), rng_(config.seed)
+        {
+            global_tf_.resize(config_.num_vocabs, 0);
+        }
+
+        void init_topics()
+        {
+            std::vector<double> zipf_cdf(config_.num_vocabs);
+            double sum = 0.0;
+            for (int32_t w = 0; w < config_.num_vocabs; ++w)
+            {
+                sum += 1.0 / std::pow(w + 1.0, config_.zipf);
+                zipf_cdf[w] = sum;
+            }
+            for (auto& p : zipf_cdf) p /= sum;
+
+            int32_t support = config_.topic_words;
+            if (support <= 0)
+            {
+                // keep the topic tables around 128MB by default
+                support = std::max(50, (1 << 24) / config_.num_topics);
+            }
+            support = std::min(support, config_.num_vocabs);
+            topics_.resize(config_.num_topics);
+            for (auto& topic : topics_) topic.init(zipf_cdf, support, rng_);
+        }
+
+        int32_t doc_length()
+        {
+            const int32_t kMaxDocLength = 8192;
+            int32_t length = config_.doc_length;
+            if (config_.length_dist == "uniform")
+            {
+                length = std::uniform_int_distribution<int32_t>(
+                    1, 2 * config_.doc_length - 1)(rng_);
+            }
+            else if (config_.length_dist == "poisson")
+            {
+                length = std::poisson_distribution<int32_t>(
+                    config_.doc_length)(rng_);
+            }
+            return std::max(1, std::min(length, kMaxDocLength));
+        }
+
+        /*!
+         * \brief Samples the topics of a document with the Polya urn of a
+         *  symmetric Dirichlet(alpha) prior, which equals drawing theta_d
+         *  and then the topics, without materializing theta_d over K topics
+         */
+        void generate_doc(std::vector<Token>& tokens)
+        {
+            int32_t length = doc_length();
+            double alpha_sum = config_.alpha * config_.num_topics;
+            std::uniform_real_distribution<double> uniform(0.0, 1.0);
+            std::uniform_int_distribution<int32_t> random_topic(
+                0, config_.num_topics - 1);
+            tokens.resize(length);
+            for (int32_t i = 0; i < length; ++i)
+            {
+                double u = uniform(rng_) * (i + alpha_sum);
+                int32_t topic = (u < i) ? tokens[static_cast<int32_t>(u)].topic_id
+                    : random_topic(rng_);
+                tokens[i].topic_id = topic;
+            }
+            for (auto& token : tokens)
+            {
+                token.word_id = topics_[token.topic_id].sample(rng_);
+            }
+            std::sort(tokens.begin(), tokens.end(), compare);
+        }
+
+        /*! \brief Generates and writes block.N, keeps the local tf */
+        void generate_block(int32_t block, int64_t num_docs)
+        {
+            std::vector<int64_t> offsets(num_docs + 1, 0);
+            std::vector<int32_t> buffer;
+            std::vector<Token> tokens;
+            std::vector<int32_t>& local_tf = local_tf_[block];
+            local_tf.assign(config_.num_vocabs, 0);
+            for (int64_t d = 0; d < num_docs; ++d)
+            {
+                generate_doc(tokens);
+                buffer.push_back(0); // cursor
+                for (auto& token : tokens)
+                {
+                    buffer.push_back(token.word_id);
+                    buffer.push_back(token.topic_id);
+                    ++local_tf[token.word_id];
+                    ++global_tf_[token.word_id];
+                }
+                offsets[d + 1] = buffer.size();
+            }
+            max_block_size_ = std::max(max_block_size_,
+                static_cast<int64_t>(buffer.size()));
+            num_tokens_ += (buffer.size() - num_docs) / 2;
+
+            std::string block_name = config_.output_dir + "/block."
+                + std::to_string(block);
+            std::ofstream block_file(block_name, std::ios::out | std::ios::binary);
+            if (!block_file.good())
+            {
+                std::cout << "Fails to create file: " << block_name << std::endl;
+                exit(1);
+            }
+            block_file.write(reinterpret_cast<char*>(&num_docs), sizeof(int64_t));
+            block_file.write(reinterpret_cast<char*>(offsets.data()),
+                sizeof(int64_t)* (num_docs + 1));
+            block_file.write(reinterpret_cast<char*>(buffer.data()),
+                sizeof(int32_t)* buffer.size());
+            block_file.close();
+        }
+
+        /*! \brief Writes vocab.N, vocab.N.txt, after all blocks are done */
+        void write_vocab(int32_t block)
+        {
+            const std::vector<int32_t>& local_tf = local_tf_[block];
+            std::vector<int32_t> vocabs;
+            for (int32_t w = 0; w < config_.num_vocabs; ++w)
+            {
+                if (local_tf[w] > 0) vocabs.push_back(w);
+            }
+            int32_t vocab_size = static_cast<int32_t>(vocabs.size());
+            std::string vocab_name = config_.output_dir + "/vocab."
+                + std::to_string(block);
+            std::ofstream vocab_file(vocab_name, std::ios::out | std::ios::binary);
+            std::ofstream txt_vocab_file(vocab_name + ".txt", std::ios::out);
+            if (!vocab_file.good() || !txt_vocab_file.good())
+            {
+                std::cout << "Fails to create file: " << vocab_name << std::endl;
+                exit(1);
+            }
+            vocab_file.write(reinterpret_cast<char*>(&vocab_size), sizeof(int32_t));
+            vocab_file.write(reinterpret_cast<char*>(vocabs.data()),
+                sizeof(int32_t)* vocab_size);
+            for (auto word : vocabs)
+            {
+                vocab_file.write(reinterpret_cast<const char*>(&global_tf_[word]),
+                    sizeof(int32_t));
+            }
+            for (auto word : vocabs)
+            {
+                vocab_file.write(reinterpret_cast<const char*>(&local_tf[word]),
+                    sizeof(int32_t));
+            }
+            vocab_file.close();
+
+            txt_vocab_file << vocab_size << std::endl;
+            for (auto word : vocabs)
+            {
+                txt_vocab_file << word << "\t" << global_tf_[word] << "\t"
+                    << local_tf[word] << std::endl;
+            }
+            txt_vocab_file.close();
+        }
+
+        /*! \brief Writes word_id.dict as word_id TAB word TAB tf */
+        void write_dict()
+        {
+            std::string dict_name = config_.output_dir + "/word_id.dict";
+            std::ofstream dict_file(dict_name, std::ios::out);
+            if (!dict_file.good())
+            {
+                std::cout << "Fails to create file: " << dict_name << std::endl;
+                exit(1);
+            }
+            for (int32_t w = 0; w < config_.num_vocabs; ++w)
+            {
+                if (global_tf_[w] > 0)
+                {
+                    dict_file << w << "\tw" << w << "\t" << global_tf_[w] << "\n";
+                }
+            }
+            dict_file.close();
+        }
+
+        /*! \brief Writes the LightLDA flags matching the generated data */
+        void write_flags()
+        {
+            const int64_t kMB = 1024 * 1024;
+            int64_t docs_per_block = (config_.num_docs + config_.num_blocks - 1)
+                / config_.num_blocks;
+            int64_t data_capacity = (max_block_size_ * sizeof(int32_t)) / kMB + 1;
+            std::string flags = "-num_vocabs " + std::to_string(config_.num_vocabs)
+                + " -num_topics " + std::to_string(config_.num_topics)
+                + " -num_blocks " + std::to_string(config_.num_blocks)
+                + " -max_num_document " + std::to_string(docs_per_block + 1)
+                + " -data_capacity " + std::to_string(data_capacity);
+            std::ofstream flags_file(config_.output_dir + "/lightlda.flags");
+            flags_file << flags << std::endl;
+            flags_file.close();
+            std::cout << "Recommended flags: " << flags << std::endl;
+        }
+
+        void run()
+        {
+            init_topics();
+            local_tf_.resize(config_.num_blocks);
+            for (int32_t block = 0; block < config_.num_blocks; ++block)
+            {
+                int64_t begin = config_.num_docs * block / config_.num_blocks;
+                int64_t end = config_.num_docs * (block + 1) / config_.num_blocks;
+                generate_block(block, end - begin);
+            }
+            for (int32_t block = 0; block < config_.num_blocks; ++block)
+            {
+                write_vocab(block);
+            }
+            write_dict();
+            std::cout << "There are totally " << num_tokens_
+                << " tokens in the data set" << std::endl;
+            write_flags();
+        }
+
+    private:
+        corpus_config config_;
+        std::mt19937_64 rng_;
+        std::vector<topic_distribution> topics_;
+        std::vector<int32_t> global_tf_;
+        std::vector<std::vector<int32_t>> local_tf_;
+        int64_t max_block_size_ = 0;
+        int64_t num_tokens_ = 0;
+    };
+}
+
+double get_time()
+{
+    auto start = std::chrono::high_resolution_clock::now();
+    auto since_epoch = start.time_since_epoch();
+    return std::chrono::duration_cast<std::chrono::duration<double, std::ratio<1, 1>>>(since_epoch).count();
+}
+
+void print_usage()
+{
+    printf("Usage: gen_corpus -output_dir <dir> [options]\n");
+    printf("-num_vocabs <arg>        Size of vocabulary. Default: 100000\n");
+    printf("-num_topics <arg>        Number of topics. Default: 1000\n");
+    printf("-num_docs <arg>          Number of documents. Default: 100000\n");
+    printf("-num_blocks <arg>        Number of output blocks. Default: 1\n");
+    printf("-doc_length <arg>        Mean document length. Default: 200\n");
+    printf("-length_dist <arg>       fixed, uniform or poisson. Default: poisson\n");
+    printf("-topic_words <arg>       Support size of each topic. Default: auto\n");
+    printf("-alpha <arg>             Dirichlet prior of doc-topic. Default: 0.1\n");
+    printf("-zipf <arg>              Exponent of Zipfian vocabulary. Default: 1.0\n");
+    printf("-seed <arg>              Random seed. Default: 1\n");
+    exit(1);
+}
+
+int main(int argc, char* argv[])
+{
+    lightlda::corpus_config config;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "-help") == 0 || strcmp(argv[i], "--help") == 0) print_usage();
+        if (i + 1 == argc) break;
+        if (strcmp(argv[i], "-output_dir") == 0) config.output_dir = argv[i + 1];
+        if (strcmp(argv[i], "-num_vocabs") == 0) config.num_vocabs = atoi(argv[i + 1]);
+        if (strcmp(argv[i], "-num_topics") == 0) config.num_topics = atoi(argv[i + 1]);
+        if (strcmp(argv[i], "-num_docs") == 0) config.num_docs = atoll(argv[i + 1]);
+        if (strcmp(argv[i], "-num_blocks") == 0) config.num_blocks = atoi(argv[i + 1]);
+        if (strcmp(argv[i], "-doc_length") == 0) config.doc_length = atoi(argv[i + 1]);
+        if (strcmp(argv[i], "-length_dist") == 0) config.length_dist = argv[i + 1];
+        if (strcmp(argv[i], "-topic_words") == 0) config.topic_words = atoi(argv[i + 1]);
+        if (strcmp(argv[i], "-alpha") == 0) config.alpha = atof(argv[i + 1]);
+        if (strcmp(argv[i], "-zipf") == 0) config.zipf = atof(argv[i + 1]);
+        if (strcmp(argv[i], "-seed") == 0) config.seed = strtoull(argv[i + 1], nullptr, 10);
+    }
+    if (config.output_dir.empty() || config.num_vocabs <= 0 || config.num_topics <= 0
+        || config.num_docs <= 0 || config.num_blocks <= 0 || config.doc_length <= 0
+        || config.num_docs < config.num_blocks)
+    {
+        print_usage();
+    }
+    if (config.length_dist != "fixed" && config.length_dist != "uniform"
+        && config.length_dist != "poisson")
+    {
+        std::cout << "Unknown length distribution: " << config.length_dist << std::endl;
+        exit(1);
+    }
+
+    double start = get_time();
+    lightlda::corpus_generator generator(config);
+    generator.run();
+    std::cout << "Elapsed seconds for generating corpus: "
+        << (get_time() - start) << std::endl;
+    return 0;
+}
@@ -5,17 +5,28 @@
 #include "util.h"
 #include "meta.h"
 
+#include <algorithm>
+
 #include <multiverso/lock.h>
 #include <multiverso/log.h>
 #include <multiverso/row.h>
 #include <multiverso/row_iter.h>
 
+namespace
+{
+    /*! \brief alias index must fit in 16 bits to use the packed layout */
+    const int32_t kMaxCompactTopics = 0xffff;
+    const int32_t kCompactShift = 16;
+    const uint32_t kCompactMask = 0xffff;
+}
+
 namespace multiverso { namespace lightlda
 {
     _THREAD_LOCAL std::vector<float>* AliasTable::q_w_proportion_;
     _THREAD_LOCAL std::vector<int32_t>* AliasTable::q_w_proportion_int_;
     _THREAD_LOCAL std::vector<std::pair<int32_t, int32_t>>* AliasTable::L_;
     _THREAD_LOCAL std::vector<std::pair<int32_t, int32_t>>* AliasTable::H_;
+    _THREAD_LOCAL std::vector<int32_t>* AliasTable::kv_;
 
     AliasTable::AliasTable()
     {
@@ -24,12 +35,13 @@ namespace multiverso { namespace lightlda
         num_topics_ = Config::num_topics;
         beta_ = Config::beta;
         beta_sum_ = beta_ * num_vocabs_;
+        compact_ = IsCompact();
         memory_block_ = new int32_t[memory_size_];
         
         beta_kv_vector_ = new int32_t[2 * num_topics_];
 
-        height_.resize(num_vocabs_);
-        mass_.resize(num_vocabs_);
+        table_index_ = nullptr;
+        position_.assign(num_vocabs_, -1);
     }
 
     AliasTable::~AliasTable()
@@ -40,7 +52,41 @@ namespace multiverso { namespace lightlda
 
     void AliasTable::Init(AliasTableIndex* table_index)
     {
+        // only the words of the previous slice are reset
+        if (table_index_ != nullptr)
+        {
+            for (int32_t i = 0; i < table_index_->size(); ++i)
+            {
+                position_[table_index_->word(i)] = -1;
+            }
+        }
         table_index_ = table_index;
+        for (int32_t i = 0; i < table_index_->size(); ++i)
+        {
+            position_[table_index_->word(i)] = i;
+        }
+        handles_.resize(table_index_->size());
+    }
+
+    bool AliasTable::IsCompact()
+    {
+        return Config::num_topics <= kMaxCompactTopics;
+    }
+
+    bool AliasTable::IsDenseRow(int32_t tf)
+    {
+        // dense row costs num_topics buckets, sparse row costs one bucket
+        // plus one topic id per entry
+        int32_t alias_thresh = IsCompact() ? Config::num_topics / 2
+            : (Config::num_topics * 2) / 3;
+        return tf > alias_thresh;
+    }
+
+    int64_t AliasTable::RowSize(bool is_dense, int32_t capacity)
+    {
+        int64_t bucket_size = IsCompact() ? 1 : 2;
+        return is_dense ? bucket_size * capacity 
+            : (bucket_size + 1) * capacity;
     }
 
     int32_t AliasTable::Build(int32_t word, ModelBase* model)
@@ -53,6 +99,8 @@ namespace multiverso { namespace lightlda
             L_ = new std::vector<std::pair<int32_t, int32_t>>(num_topics_);
         if (H_ == nullptr)
             H_ = new std::vector<std::pair<int32_t, int32_t>>(num_topics_);
+        if (kv_ == nullptr && compact_)
+            kv_ = new std::vector<int32_t>(2 * num_topics_);
         // Compute the proportion
         Row<int64_t>& summary_row = model->GetSummaryRow();
         if (word == -1) // build alias row for beta 
@@ -68,25 +116,31 @@ namespace multiverso { namespace lightlda
         }
         else // build alias row for word
         {            
-            WordEntry& word_entry = table_index_->word_entry(word);
+            int32_t position = position_[word];
+            const WordEntry& word_entry = table_index_->entry(position);
+            WordHandle& handle = handles_[position];
             Row<int32_t>& word_topic_row = model->GetWordTopicRow(word);
+            handle.row = &word_topic_row;
+            handle.alias_row = memory_block_ + word_entry.begin_offset;
+            handle.is_dense = word_entry.is_dense;
+            handle.mass = 0;
             int32_t size = 0;
-            mass_[word] = 0;
             if (word_entry.is_dense)
             {
                 size = num_topics_;
+                handle.capacity = num_topics_;
                 for (int32_t k = 0; k < num_topics_; ++k)
                 {
                     (*q_w_proportion_)[k] = (word_topic_row.At(k) + beta_)
                         / (summary_row.At(k) + beta_sum_);
-                    mass_[word] += (*q_w_proportion_)[k];
+                    handle.mass += (*q_w_proportion_)[k];
                 }
             }
             else // word_entry.is_dense = false
             {
-                word_entry.capacity = word_topic_row.NonzeroSize();
-                int32_t* idx_vector = memory_block_ + word_entry.begin_offset 
-                    + 2 * word_entry.capacity;
+                handle.capacity = word_topic_row.NonzeroSize();
+                int32_t* idx_vector = handle.alias_row
+                    + RowSize(true, handle.capacity);
                 Row<int32_t>::iterator iter = word_topic_row.Iterator();
                 while (iter.HasNext())
                 {
@@ -95,7 +149,7 @@ namespace multiverso { namespace lightlda
                     int64_t n_t = summary_row.At(t);
                     idx_vector[size] = t;
                     (*q_w_proportion_)[size] = (n_tw) / (n_t + beta_sum_);
-                    mass_[word] += (*q_w_proportion_)[size];
+                    handle.mass += (*q_w_proportion_)[size];
                     ++size;
                     iter.Next();
                 }
@@ -105,24 +159,65 @@ namespace multiverso { namespace lightlda
                         word_topic_row.NonzeroSize());
                 }
             }
-            AliasMultinomialRNG(size, mass_[word], height_[word], 
-                memory_block_ + word_entry.begin_offset);
+            if (compact_)
+            {
+                AliasMultinomialRNG(size, handle.mass, handle.height, 
+                    kv_->data());
+                PackAliasRow(size, handle.height, kv_->data(), 
+                    reinterpret_cast<uint32_t*>(handle.alias_row));
+            }
+            else
+            {
+                AliasMultinomialRNG(size, handle.mass, handle.height, 
+                    handle.alias_row);
+            }
         }
         return 0;
     }
 
     int32_t AliasTable::Propose(int32_t word, xorshift_rng& rng)
     {
-        WordEntry& word_entry = table_index_->word_entry(word);
-        int32_t* kv_vector = memory_block_ + word_entry.begin_offset;
-        int32_t capacity = word_entry.capacity;
-        if (word_entry.is_dense)
+        return Propose(handle(word), rng);
+    }
+
+    int32_t AliasTable::Propose(const WordHandle& handle, xorshift_rng& rng)
+    {
+        const int32_t* kv_vector = handle.alias_row;
+        int32_t capacity = handle.capacity;
+        if (compact_)
+        {
+            const uint32_t* packed_vector = 
+                reinterpret_cast<const uint32_t*>(kv_vector);
+            if (!handle.is_dense)
+            {
+                auto sample = rng.rand_double() * (handle.mass + beta_mass_);
+                if (sample >= handle.mass) 
+                {
+                    return ProposeBeta(rng);
+                }
+            }
+            // Split one 31-bit random number into a bucket index and a 
+            // 16-bit fraction within the bucket
+            uint64_t x = static_cast<uint64_t>(rng.rand()) * capacity;
+            int32_t idx = static_cast<int32_t>(x >> 31);
+            uint32_t frac = static_cast<uint32_t>(x >> 15) & kCompactMask;
+            uint32_t bucket = packed_vector[idx];
+            int32_t k = static_cast<int32_t>(bucket >> kCompactShift);
+            int32_t m = -(frac < (bucket & kCompactMask));
+            if (handle.is_dense)
+            {
+                return (idx & m) | (k & ~m);
+            }
+            const int32_t* idx_vector = kv_vector + capacity;
+            return (idx_vector[idx] & m) | (idx_vector[k] & ~m);
+        }
+        if (handle.is_dense)
         {
             auto sample = rng.rand();
-            int32_t idx = sample / height_[word];
+            int32_t idx = sample / handle.height;
             if (capacity <= idx) idx = capacity - 1;
 
-            int32_t* p = kv_vector + 2 * idx;
+            const int32_t* p = kv_vector + 2 * idx;
             int32_t k = *p++;
             int32_t v = *p;
             int32_t m = -(sample < v);
@@ -130,14 +225,14 @@ namespace multiverso { namespace lightlda
         }
         else
         {
-            auto sample = rng.rand_double() * (mass_[word] + beta_mass_);
-            if (sample < mass_[word])
+            auto sample = rng.rand_double() * (handle.mass + beta_mass_);
+            if (sample < handle.mass)
             {
-                int32_t* idx_vector = kv_vector + 2 * word_entry.capacity;
+                const int32_t* idx_vector = kv_vector + 2 * capacity;
                 auto n_kw_sample = rng.rand();
-                int32_t idx = n_kw_sample / height_[word];
+                int32_t idx = n_kw_sample / handle.height;
                 if (capacity <= idx) idx = capacity - 1;
-                int32_t* p = kv_vector + 2 * idx;
+                const int32_t* p = kv_vector + 2 * idx;
                 int32_t k = *p++;
                 int32_t v = *p;
                 int32_t id = idx_vector[idx];
@@ -146,18 +241,23 @@ namespace multiverso { namespace lightlda
             }
             else
             {
-                auto beta_sample = rng.rand();
-                int32_t idx = beta_sample / beta_height_;
-                if (num_topics_ <= idx) idx = num_topics_ - 1;
-                int32_t* p = beta_kv_vector_ + 2 * idx;
-                int32_t k = *p++;
-                int32_t v = *p;
-                int32_t m = -(beta_sample < v);
-                return (idx & m) | (k & ~m);
+                return ProposeBeta(rng);
             }
         }
     }
 
+    int32_t AliasTable::ProposeBeta(xorshift_rng& rng)
+    {
+        auto beta_sample = rng.rand();
+        int32_t idx = beta_sample / beta_height_;
+        if (num_topics_ <= idx) idx = num_topics_ - 1;
+        int32_t* p = beta_kv_vector_ + 2 * idx;
+        int32_t k = *p++;
+        int32_t v = *p;
+        int32_t m = -(beta_sample < v);
+        return (idx & m) | (k & ~m);
+    }
+
     void AliasTable::Clear()
     {
         delete q_w_proportion_;
@@ -168,6 +268,30 @@ namespace multiverso { namespace lightlda
         L_ = nullptr;
         delete H_;
         H_ = nullptr;
+        delete kv_;
+        kv_ = nullptr;
+    }
+
+    void AliasTable::PackAliasRow(int32_t size, int32_t height,
+        const int32_t* kv_vector, uint32_t* packed_vector)
+    {
+        for (int32_t k = 0; k < size; ++k)
+        {
+            int32_t alias = kv_vector[2 * k];
+            int64_t v = kv_vector[2 * k + 1] - static_cast<int64_t>(k) * height;
+            uint32_t threshold = 0;
+            if (v >= height)
+            {
+                // the bucket never uses its alias
+                alias = k;
+            }
+            else if (v > 0)
+            {
+                threshold = static_cast<uint32_t>((v << kCompactShift) / height);
+            }
+            packed_vector[k] = (static_cast<uint32_t>(alias) << kCompactShift)
+                | threshold;
+        }
     }
 
 
@@ -182,8 +306,10 @@ namespace multiverso { namespace lightlda
         for (int32_t i = 0; i < size; ++i)
         {
             (*q_w_proportion_)[i] /= mass;
-            (*q_w_proportion_int_)[i] =
-                static_cast<int32_t>((*q_w_proportion_)[i] * mass_int);
+            // a proportion rounded to 1.0f would overflow int32
+            (*q_w_proportion_int_)[i] = static_cast<int32_t>(std::min(
+                static_cast<double>((*q_w_proportion_)[i]) * mass_int,
+                static_cast<double>(mass_int)));
             mass_sum += (*q_w_proportion_int_)[i];
         }
         if (mass_sum > mass_int)
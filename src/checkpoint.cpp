@@ -0,0 +1,541 @@
+#include "checkpoint.h"
+
+#include "common.h"
+#include "data_block.h"
+#include "document.h"
+#include "meta.h"
+#include "trace.h"
+
+#include <multiverso/log.h>
+#include <multiverso/multiverso.h>
+
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
+#if defined(_WIN32) || defined(_WIN64)
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+namespace
+{
+    /*! \brief rows are flushed to the shard file in buffers of this size */
+    const size_t kBufferSize = 1 << 20;
+    /*! \brief max bytes of snapshots queued for the writer thread */
+    const int64_t kMaxPendingBytes = 1LL << 30;
+    const int32_t kFormatVersion = 1;
+
+    std::string ShardName(const std::string& dir, int32_t shard)
+    {
+        return dir + "/word_topic." + std::to_string(shard);
+    }
+
+    std::string DocTopicName(const std::string& dir, int32_t block,
+        int32_t part)
+    {
+        return dir + "/doc_topic." + std::to_string(block) + "."
+            + std::to_string(part);
+    }
+
+    /*! \brief Reads the whole file as int32s */
+    void ReadFile(const std::string& file_name, std::vector<int32_t>& buffer)
+    {
+        std::ifstream file(file_name, std::ios::in | std::ios::binary);
+        if (!file.good())
+        {
+            multiverso::Log::Fatal("Failed to open checkpoint file %s\n",
+                file_name.c_str());
+        }
+        file.seekg(0, std::ios::end);
+        int64_t size = file.tellg();
+        file.seekg(0, std::ios::beg);
+        buffer.resize(size / sizeof(int32_t));
+        file.read(reinterpret_cast<char*>(buffer.data()), size);
+        if (!file.good() || size % sizeof(int32_t) != 0)
+        {
+            multiverso::Log::Fatal("Failed to read checkpoint file %s\n",
+                file_name.c_str());
+        }
+    }
+
+    /*! \brief Writes data to a new file, Fatal on I/O errors */
+    void WriteFile(const std::string& file_name, const void* data,
+        int64_t size)
+    {
+        std::ofstream file(file_name, std::ios::out | std::ios::binary);
+        file.write(static_cast<const char*>(data), size);
+        file.close();
+        if (file.fail())
+        {
+            multiverso::Log::Fatal("Failed to write checkpoint file %s\n",
+                file_name.c_str());
+        }
+    }
+}
+
+namespace multiverso { namespace lightlda
+{
+    std::vector<int32_t> Checkpoint::owner_block_;
+    std::mutex CheckpointQueue::mutex_;
+    std::condition_variable CheckpointQueue::cond_;
+    std::deque<std::pair<CheckpointQueue::Task, int64_t>> CheckpointQueue::tasks_;
+    int64_t CheckpointQueue::pending_bytes_ = 0;
+    bool CheckpointQueue::stop_ = false;
+    std::thread CheckpointQueue::thread_;
+
+    void CheckpointQueue::Start()
+    {
+        if (Config::checkpoint_dir.empty() || thread_.joinable()) return;
+        stop_ = false;
+        thread_ = std::thread(&CheckpointQueue::WriterMain);
+    }
+
+    void CheckpointQueue::Push(const Task& task, int64_t bytes)
+    {
+        if (!thread_.joinable())
+        {
+            task();
+            return;
+        }
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (pending_bytes_ > 0 && pending_bytes_ + bytes > kMaxPendingBytes)
+        {
+            TRACE_SCOPE("CheckpointQueue::WaitWriter");
+            // an oversized snapshot is still queued once the queue is empty
+            cond_.wait(lock, [&]{ return pending_bytes_ == 0 ||
+                pending_bytes_ + bytes <= kMaxPendingBytes; });
+        }
+        tasks_.emplace_back(task, bytes);
+        pending_bytes_ += bytes;
+        cond_.notify_all();
+    }
+
+    void CheckpointQueue::Close()
+    {
+        if (!thread_.joinable()) return;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        cond_.notify_all();
+        thread_.join();
+    }
+
+    void CheckpointQueue::WriterMain()
+    {
+        while (true)
+        {
+            std::pair<Task, int64_t> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cond_.wait(lock, [&]{ return stop_ || !tasks_.empty(); });
+                // queued writes are drained before stopping
+                if (tasks_.empty()) return;
+                task = std::move(tasks_.front());
+                tasks_.pop_front();
+            }
+            {
+                TRACE_SCOPE("CheckpointQueue::Write");
+                task.first();
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                pending_bytes_ -= task.second;
+            }
+            cond_.notify_all();
+        }
+    }
+
+    CheckpointWriter::CheckpointWriter() : num_rows_(0) {}
+
+    void CheckpointWriter::Open(const std::string& dir, int32_t shard)
+    {
+        file_name_ = ShardName(dir, shard);
+        file_ = std::make_shared<std::ofstream>(file_name_,
+            std::ios::out | std::ios::binary);
+        if (!file_->good())
+        {
+            Log::Fatal("Failed to create checkpoint file %s\n",
+                file_name_.c_str());
+        }
+        buffer_.reserve(kBufferSize / sizeof(int32_t));
+        num_rows_ = 0;
+    }
+
+    void CheckpointWriter::WriteRow(int32_t word, Row<int32_t>& row)
+    {
+        size_t head = buffer_.size();
+        buffer_.push_back(word);
+        buffer_.push_back(0);
+        Row<int32_t>::iterator iter = row.Iterator();
+        while (iter.HasNext())
+        {
+            if (iter.Value() != 0)
+            {
+                buffer_.push_back(iter.Key());
+                buffer_.push_back(iter.Value());
+            }
+            iter.Next();
+        }
+        buffer_[head + 1] = static_cast<int32_t>((buffer_.size() - head - 2) / 2);
+        ++num_rows_;
+        if (buffer_.size() * sizeof(int32_t) >= kBufferSize) Flush();
+    }
+
+    void CheckpointWriter::Close()
+    {
+        Flush();
+        std::shared_ptr<std::ofstream> file = file_;
+        std::string file_name = file_name_;
+        CheckpointQueue::Push([file, file_name]()
+        {
+            file->close();
+            if (file->fail())
+            {
+                Log::Fatal("Failed to write checkpoint file %s\n",
+                    file_name.c_str());
+            }
+        }, 0);
+        file_.reset();
+    }
+
+    void CheckpointWriter::Flush()
+    {
+        if (buffer_.empty()) return;
+        // the full buffer is handed over, a fresh one takes the next rows
+        auto snapshot = std::make_shared<std::vector<int32_t>>();
+        snapshot->swap(buffer_);
+        buffer_.reserve(kBufferSize / sizeof(int32_t));
+        std::shared_ptr<std::ofstream> file = file_;
+        int64_t bytes = sizeof(int32_t) * snapshot->size();
+        CheckpointQueue::Push([file, snapshot, bytes]()
+        {
+            file->write(reinterpret_cast<const char*>(snapshot->data()),
+                bytes);
+        }, bytes);
+    }
+
+    void Checkpoint::Init(const Meta& meta)
+    {
+        if (Config::checkpoint_dir.empty()) return;
+        owner_block_.assign(Config::num_vocabs, -1);
+        for (int32_t block = 0; block < Config::num_blocks; ++block)
+        {
+            const LocalVocab& vocab = meta.local_vocab(block);
+            for (const int32_t* p = vocab.begin(0);
+                p != vocab.end(vocab.num_slice() - 1); ++p)
+            {
+                owner_block_[*p] = block;
+            }
+        }
+    }
+
+    bool Checkpoint::IsDue(int32_t iteration)
+    {
+        if (Config::checkpoint_dir.empty()) return false;
+        return iteration == Config::num_iterations - 1 ||
+            (Config::checkpoint_interval > 0 &&
+            (iteration + 1) % Config::checkpoint_interval == 0);
+    }
+
+    std::string Checkpoint::Directory(int32_t iteration)
+    {
+        // every process checkpoints its own blocks
+        std::string dir = Config::checkpoint_dir + "/iter." +
+            std::to_string(iteration);
+        if (Multiverso::TotalProcessCount() > 1)
+        {
+            dir += ".rank." + std::to_string(Multiverso::ProcessRank());
+        }
+        return dir;
+    }
+
+    std::string Checkpoint::ResumeDirectory()
+    {
+        // the same suffix as Directory, as every process resumes from the
+        // checkpoint of its own blocks
+        std::string dir = Config::resume_dir;
+        if (Multiverso::TotalProcessCount() > 1)
+        {
+            dir += ".rank." + std::to_string(Multiverso::ProcessRank());
+        }
+        return dir;
+    }
+
+    bool Checkpoint::OwnsWord(int32_t block, int32_t word)
+    {
+        return owner_block_[word] == block;
+    }
+
+    void Checkpoint::PartRange(int32_t num_docs, int32_t part,
+        int32_t num_parts, int32_t& begin, int32_t& end)
+    {
+        begin = static_cast<int32_t>(static_cast<int64_t>(num_docs) * part / num_parts);
+        end = static_cast<int32_t>(static_cast<int64_t>(num_docs) * (part + 1) / num_parts);
+    }
+
+    void Checkpoint::CreateDirectory(const std::string& dir)
+    {
+        for (const std::string& path : { Config::checkpoint_dir, dir })
+        {
+#if defined(_WIN32) || defined(_WIN64)
+            _mkdir(path.c_str());
+#else
+            mkdir(path.c_str(), 0755);
+#endif
+        }
+    }
+
+    void Checkpoint::WriteDocTopics(const std::string& dir, int32_t block,
+        int32_t part, DataBlock& data, int32_t doc_begin, int32_t doc_end)
+    {
+        // the int64 number of tokens heads the topics as two int32s
+        auto topics = std::make_shared<std::vector<int32_t>>(2);
+        for (int32_t i = doc_begin; i < doc_end; ++i)
+        {
+            Document doc = data.GetOneDoc(i);
+            for (int32_t j = 0; j < doc.Size(); ++j)
+            {
+                topics->push_back(doc.Topic(j));
+            }
+        }
+        int64_t num_tokens = topics->size() - 2;
+        memcpy(topics->data(), &num_tokens, sizeof(int64_t));
+        std::string file_name = DocTopicName(dir, block, part);
+        int64_t bytes = sizeof(int32_t) * topics->size();
+        CheckpointQueue::Push([file_name, topics, bytes]()
+        {
+            WriteFile(file_name, topics->data(), bytes);
+        }, bytes);
+    }
+
+    void Checkpoint::WriteSummary(const std::string& dir, Row<int64_t>& row)
+    {
+        auto summary = std::make_shared<std::vector<int64_t>>(
+            Config::num_topics, 0);
+        Row<int64_t>::iterator iter = row.Iterator();
+        while (iter.HasNext())
+        {
+            (*summary)[iter.Key()] = iter.Value();
+            iter.Next();
+        }
+        std::string file_name = dir + "/summary";
+        int64_t bytes = sizeof(int64_t) * summary->size();
+        CheckpointQueue::Push([file_name, summary, bytes]()
+        {
+            WriteFile(file_name, summary->data(), bytes);
+        }, bytes);
+    }
+
+    void Checkpoint::WriteManifest(const std::string& dir,
+        const CheckpointManifest& manifest)
+    {
+        CheckpointQueue::Push([dir, manifest]()
+        {
+            WriteManifestFile(dir, manifest);
+            Log::Info("Rank = %d, checkpoint written to %s\n",
+                Multiverso::ProcessRank(), dir.c_str());
+        }, 0);
+    }
+
+    void Checkpoint::WriteManifestFile(const std::string& dir,
+        const CheckpointManifest& manifest)
+    {
+        // the manifest marks a complete checkpoint, so it is renamed into
+        // place after everything else is written
+        std::string file_name = dir + "/manifest";
+        std::string temp_name = file_name + ".tmp";
+        std::ofstream file(temp_name, std::ios::out);
+        file << "format " << kFormatVersion << "\n"
+            << "iteration " << manifest.iteration << "\n"
+            << "num_vocabs " << manifest.num_vocabs << "\n"
+            << "num_topics " << manifest.num_topics << "\n"
+            << "num_blocks " << manifest.num_blocks << "\n"
+            << "num_shards " << manifest.num_shards << "\n"
+            << "doc_topic " << (manifest.has_doc_topic ? 1 : 0) << "\n";
+        for (int32_t shard = 0; shard < manifest.num_shards; ++shard)
+        {
+            file << "shard_rows " << manifest.shard_rows[shard] << "\n";
+        }
+        file.close();
+        if (file.fail() || std::rename(temp_name.c_str(), file_name.c_str()) != 0)
+        {
+            Log::Fatal("Failed to write checkpoint file %s\n", file_name.c_str());
+        }
+    }
+
+    bool Checkpoint::Exists(const std::string& dir)
+    {
+        return std::ifstream(dir + "/manifest").good();
+    }
+
+    void Checkpoint::ReadManifest(const std::string& dir,
+        CheckpointManifest& manifest)
+    {
+        std::string file_name = dir + "/manifest";
+        std::ifstream file(file_name, std::ios::in);
+        if (!file.good())
+        {
+            Log::Fatal("Failed to open checkpoint manifest %s\n", file_name.c_str());
+        }
+        int32_t version = 0, has_doc_topic = 0;
+        manifest.num_shards = 0;
+        manifest.shard_rows.clear();
+        std::string key;
+        while (file >> key)
+        {
+            if (key == "format") file >> version;
+            else if (key == "iteration") file >> manifest.iteration;
+            else if (key == "num_vocabs") file >> manifest.num_vocabs;
+            else if (key == "num_topics") file >> manifest.num_topics;
+            else if (key == "num_blocks") file >> manifest.num_blocks;
+            else if (key == "num_shards") file >> manifest.num_shards;
+            else if (key == "doc_topic") file >> has_doc_topic;
+            else if (key == "shard_rows")
+            {
+                int64_t rows = 0;
+                file >> rows;
+                manifest.shard_rows.push_back(rows);
+            }
+            else std::getline(file, key);
+        }
+        manifest.has_doc_topic = has_doc_topic != 0;
+        if (version != kFormatVersion || manifest.num_shards <= 0 ||
+            static_cast<int32_t>(manifest.shard_rows.size()) != manifest.num_shards)
+        {
+            Log::Fatal("Invalid checkpoint manifest %s\n", file_name.c_str());
+        }
+    }
+
+    void Checkpoint::ReadShard(const std::string& dir,
+        const CheckpointManifest& manifest, int32_t shard,
+        std::vector<int32_t>& buffer)
+    {
+        std::string file_name = ShardName(dir, shard);
+        ReadFile(file_name, buffer);
+        int64_t num_rows = 0;
+        for (size_t pos = 0; pos < buffer.size(); ++num_rows)
+        {
+            int32_t size = pos + 1 < buffer.size() ? buffer[pos + 1] : -1;
+            if (size < 0 || pos + 2 + 2 * static_cast<size_t>(size) > buffer.size() ||
+                buffer[pos] < 0 || buffer[pos] >= manifest.num_vocabs)
+            {
+                Log::Fatal("Corrupted checkpoint file %s\n", file_name.c_str());
+            }
+            pos += 2 + 2 * static_cast<size_t>(size);
+        }
+        if (num_rows != manifest.shard_rows[shard])
+        {
+            Log::Fatal("Checkpoint file %s has %lld rows, expected %lld\n",
+                file_name.c_str(), static_cast<long long>(num_rows),
+                static_cast<long long>(manifest.shard_rows[shard]));
+        }
+    }
+
+    void Checkpoint::VisitShard(const std::vector<int32_t>& shard,
+        const RowVisitor& visitor)
+    {
+        for (size_t pos = 0; pos < shard.size();
+            pos += 2 + 2 * static_cast<size_t>(shard[pos + 1]))
+        {
+            visitor(shard[pos], shard.data() + pos + 2, shard[pos + 1]);
+        }
+    }
+
+    void Checkpoint::ReadWordTopic(const std::string& dir,
+        const CheckpointManifest& manifest, const RowVisitor& visitor)
+    {
+        auto read_shard = [&](int32_t shard)
+        {
+            std::vector<int32_t> buffer;
+            ReadShard(dir, manifest, shard, buffer);
+            VisitShard(buffer, visitor);
+        };
+        std::vector<std::thread> threads;
+        for (int32_t shard = 1; shard < manifest.num_shards; ++shard)
+        {
+            threads.emplace_back(read_shard, shard);
+        }
+        read_shard(0);
+        for (auto& thread : threads) thread.join();
+    }
+
+    void Checkpoint::ReadWordTopicShards(const std::string& dir,
+        const CheckpointManifest& manifest,
+        std::vector<std::vector<int32_t>>& shards)
+    {
+        shards.clear();
+        shards.resize(manifest.num_shards);
+        std::vector<std::thread> threads;
+        for (int32_t shard = 1; shard < manifest.num_shards; ++shard)
+        {
+            threads.emplace_back(ReadShard, std::cref(dir), std::cref(manifest),
+                shard, std::ref(shards[shard]));
+        }
+        if (manifest.num_shards > 0) ReadShard(dir, manifest, 0, shards[0]);
+        for (auto& thread : threads) thread.join();
+    }
+
+    void Checkpoint::ReadSummary(const std::string& dir,
+        const CheckpointManifest& manifest, std::vector<int64_t>& summary)
+    {
+        std::string file_name = dir + "/summary";
+        std::ifstream file(file_name, std::ios::in | std::ios::binary);
+        summary.resize(manifest.num_topics);
+        file.read(reinterpret_cast<char*>(summary.data()),
+            sizeof(int64_t) * summary.size());
+        if (!file.good())
+        {
+            Log::Fatal("Failed to read checkpoint file %s\n", file_name.c_str());
+        }
+    }
+
+    void Checkpoint::ReadDocTopics(const std::string& dir,
+        const CheckpointManifest& manifest, int32_t block, DataBlock& data)
+    {
+        auto read_part = [&](int32_t part)
+        {
+            std::string file_name = DocTopicName(dir, block, part);
+            std::vector<int32_t> buffer;
+            ReadFile(file_name, buffer);
+            int32_t doc_begin, doc_end;
+            PartRange(data.Size(), part, manifest.num_shards, doc_begin, doc_end);
+            int64_t num_tokens = 0;
+            for (int32_t i = doc_begin; i < doc_end; ++i)
+            {
+                num_tokens += data.GetOneDoc(i).Size();
+            }
+            // int64 token count is stored as two int32s
+            int64_t stored_tokens = -1;
+            if (buffer.size() >= 2)
+            {
+                memcpy(&stored_tokens, buffer.data(), sizeof(int64_t));
+            }
+            if (stored_tokens != num_tokens ||
+                static_cast<int64_t>(buffer.size()) != num_tokens + 2)
+            {
+                Log::Fatal("Checkpoint file %s mismatches block %d\n",
+                    file_name.c_str(), block);
+            }
+            const int32_t* topic = buffer.data() + 2;
+            for (int32_t i = doc_begin; i < doc_end; ++i)
+            {
+                Document doc = data.GetOneDoc(i);
+                for (int32_t j = 0; j < doc.Size(); ++j)
+                {
+                    doc.SetTopic(j, *topic++);
+                }
+            }
+        };
+        std::vector<std::thread> threads;
+        for (int32_t part = 1; part < manifest.num_shards; ++part)
+        {
+            threads.emplace_back(read_part, part);
+        }
+        read_part(0);
+        for (auto& thread : threads) thread.join();
+    }
+} // namespace lightlda
+} // namespace multiverso
@@ -10,18 +10,32 @@ namespace multiverso { namespace lightlda
     int32_t Config::num_topics = 1000;
     int32_t Config::num_iterations = 10;
     int32_t Config::mh_steps = 2;
+    int32_t Config::prefetch_tokens = 0;
     int32_t Config::num_servers = 1;
     int32_t Config::num_local_workers = 1;
     int32_t Config::num_aggregator = 1;
+    int32_t Config::alias_builders = 0;
     int32_t Config::num_blocks = 1;
     int64_t Config::max_num_document = 1;
     float Config::alpha = 0.50f;
     float Config::beta = 0.01f;
     std::string Config::server_file = "";
     std::string Config::input_dir = "./";
+    std::string Config::metrics_file = "";
+    std::string Config::trace_file = "";
+    std::string Config::io_engine = "stream";
+    std::string Config::checkpoint_dir = "";
+    std::string Config::resume_dir = "";
     bool Config::warm_start = false;
     bool Config::inference = false;
     bool Config::out_of_core = false;
+    bool Config::mmap_data = false;
+    bool Config::topic_file = false;
+    int32_t Config::prefetch_buffers = 2;
+    int32_t Config::prefetch_depth = 0;
+    int32_t Config::checkpoint_interval = 0;
+    bool Config::checkpoint_doc_topic = false;
+    int32_t Config::model_refresh_interval = 1;
     int64_t Config::data_capacity = 8 * kMB;
     int64_t Config::model_capacity = 512 * kMB;
     int64_t Config::delta_capacity = 256 * kMB;
@@ -44,17 +58,31 @@ namespace multiverso { namespace lightlda
             if (strcmp(argv[i], "-num_topics") == 0) num_topics = atoi(argv[i + 1]);
             if (strcmp(argv[i], "-num_iterations") == 0) num_iterations = atoi(argv[i + 1]);
             if (strcmp(argv[i], "-mh_steps") == 0) mh_steps = atoi(argv[i + 1]);
+            if (strcmp(argv[i], "-prefetch_tokens") == 0) prefetch_tokens = atoi(argv[i + 1]);
             if (strcmp(argv[i], "-num_servers") == 0) num_servers = atoi(argv[i + 1]);
             if (strcmp(argv[i], "-num_local_workers") == 0) num_local_workers = atoi(argv[i + 1]);
             if (strcmp(argv[i], "-num_aggregator") == 0) num_aggregator = atoi(argv[i + 1]);
+            if (strcmp(argv[i], "-alias_builders") == 0) alias_builders = atoi(argv[i + 1]);
             if (strcmp(argv[i], "-num_blocks") == 0) num_blocks = atoi(argv[i + 1]);
             if (strcmp(argv[i], "-max_num_document") == 0) max_num_document = atoll(argv[i + 1]);
             if (strcmp(argv[i], "-alpha") == 0) alpha = static_cast<float>(atof(argv[i + 1]));
             if (strcmp(argv[i], "-beta") == 0) beta = static_cast<float>(atof(argv[i + 1]));
             if (strcmp(argv[i], "-input_dir") == 0) input_dir = std::string(argv[i + 1]);
             if (strcmp(argv[i], "-server_file") == 0) server_file = std::string(argv[i + 1]);
+            if (strcmp(argv[i], "-metrics_file") == 0) metrics_file = std::string(argv[i + 1]);
+            if (strcmp(argv[i], "-trace_file") == 0) trace_file = std::string(argv[i + 1]);
+            if (strcmp(argv[i], "-io_engine") == 0) io_engine = std::string(argv[i + 1]);
             if (strcmp(argv[i], "-warm_start") == 0) warm_start = true;
             if (strcmp(argv[i], "-out_of_core") == 0) out_of_core = true;
+            if (strcmp(argv[i], "-mmap_data") == 0) mmap_data = true;
+            if (strcmp(argv[i], "-topic_file") == 0) topic_file = true;
+            if (strcmp(argv[i], "-prefetch_buffers") == 0) prefetch_buffers = atoi(argv[i + 1]);
+            if (strcmp(argv[i], "-prefetch_depth") == 0) prefetch_depth = atoi(argv[i + 1]);
+            if (strcmp(argv[i], "-checkpoint_dir") == 0) checkpoint_dir = std::string(argv[i + 1]);
+            if (strcmp(argv[i], "-checkpoint_interval") == 0) checkpoint_interval = atoi(argv[i + 1]);
+            if (strcmp(argv[i], "-checkpoint_doc_topic") == 0) checkpoint_doc_topic = true;
+            if (strcmp(argv[i], "-resume_dir") == 0) resume_dir = std::string(argv[i + 1]);
+            if (strcmp(argv[i], "-model_refresh_interval") == 0) model_refresh_interval = atoi(argv[i + 1]);
             if (strcmp(argv[i], "-data_capacity") == 0) data_capacity = atoi(argv[i + 1]) * kMB;
             if (strcmp(argv[i], "-model_capacity") == 0) model_capacity = atoi(argv[i + 1]) * kMB;
             if (strcmp(argv[i], "-alias_capacity") == 0) alias_capacity = atoi(argv[i + 1]) * kMB;
@@ -70,6 +98,9 @@ namespace multiverso { namespace lightlda
         printf("-num_topics <arg>        Number of topics. Default: 100\n");
         printf("-num_iterations <arg>    Number of iteratioins. Default: 100\n");
         printf("-mh_steps <arg>          Metropolis-hasting steps. Default: 2\n");
+        printf("-prefetch_tokens <arg>   Tokens ahead whose alias rows the sampler\n");
+        printf("                         prefetches, model rows are not prefetched.\n");
+        printf("                         Default: 0 (off)\n");
         printf("-alpha <arg>             Dirichlet prior alpha. Default: 0.1\n");
         printf("-beta <arg>              Dirichlet prior beta. Default: 0.01\n\n");
         printf("-num_blocks <arg>        Number of blocks in disk. Default: 1\n");
@@ -79,9 +110,36 @@ namespace multiverso { namespace lightlda
         printf("-num_servers <arg>       Number of servers. Default: 1\n");
         printf("-num_local_workers <arg> Number of local training threads. Default: 4\n");
         printf("-num_aggregator <arg>    Number of local aggregation threads. Default: 1\n");
+        printf("-alias_builders <arg>    Number of local threads building alias tables\n");
+        printf("                         ahead of sampling. Default: 0 (no pipeline)\n");
         printf("-server_file <arg>       Server endpoint file. Used by MPI-free version\n"); 
         printf("-warm_start              Warm start \n");
-        printf("-out_of_core             Use out of core computing \n\n");
+        printf("-out_of_core             Use out of core computing \n");
+        printf("-mmap_data               Map data blocks into memory, sized by the\n");
+        printf("                         block files instead of -data_capacity\n");
+        printf("-topic_file              Write back only topics, to block.N.topics\n");
+        printf("                         files next to the read-only block files\n");
+        printf("-io_engine <arg>         I/O of block files, stream or direct (O_DIRECT,\n");
+        printf("                         bypassing page cache). Default: stream\n");
+        printf("-prefetch_buffers <arg>  Number of block buffers of out of core\n");
+        printf("                         computing. Default: 2\n");
+        printf("-prefetch_depth <arg>    Max number of blocks read ahead of training.\n");
+        printf("                         Default: 0 (prefetch_buffers - 1)\n");
+        printf("-checkpoint_dir <arg>    Write binary checkpoints to <arg>/iter.N, or\n");
+        printf("                         <arg>/iter.N.rank.<rank> with several processes\n");
+        printf("-checkpoint_interval <arg> Iterations between checkpoints.\n");
+        printf("                         Default: 0 (after the last iteration only)\n");
+        printf("-checkpoint_doc_topic    Include topics of documents in checkpoints\n");
+        printf("-resume_dir <arg>        Resume training from a checkpoint written\n");
+        printf("                         with -checkpoint_doc_topic. With several\n");
+        printf("                         processes, each resumes from <arg>.rank.<rank>\n");
+        printf("-model_refresh_interval <arg> Iterations between requests of each\n");
+        printf("                         word-topic row, if the local model fits\n");
+        printf("                         -model_capacity. 0 fetches rows once and\n");
+        printf("                         then applies local deltas only, exact for\n");
+        printf("                         one process. Default: 1 (every iteration)\n");
+        printf("-metrics_file <arg>      Write per-slice training metrics as JSON lines\n");
+        printf("-trace_file <arg>        Write a chrome://tracing timeline at exit\n\n");
         printf("-data_capacity <arg>     Memory pool size(MB) for data storage, \n");
         printf("                         should larger than the any data block\n");
         printf("-model_capacity <arg>    Memory pool size(MB) for local model cache\n");
@@ -97,6 +155,9 @@ namespace multiverso { namespace lightlda
         printf("-num_topics <arg>        Number of topics. Default: 100\n");
         printf("-num_iterations <arg>    Number of iteratioins. Default: 100\n");
         printf("-mh_steps <arg>          Metropolis-hasting steps. Default: 2\n");
+        printf("-prefetch_tokens <arg>   Tokens ahead whose alias rows the sampler\n");
+        printf("                         prefetches, model rows are not prefetched.\n");
+        printf("                         Default: 0 (off)\n");
         printf("-alpha <arg>             Dirichlet prior alpha. Default: 0.1\n");
         printf("-beta <arg>              Dirichlet prior beta. Default: 0.01\n\n");
         printf("-num_blocks <arg>        Number of blocks in disk. Default: 1\n");
@@ -129,6 +190,14 @@ namespace multiverso { namespace lightlda
         {
             PrintUsage();
         }
+        if (io_engine != "stream" && io_engine != "direct")
+        {
+            PrintUsage();
+        }
+        if (model_refresh_interval < 0)
+        {
+            PrintUsage();
+        }
     }
 } // namespace lightlda
 } // namespace multiverso
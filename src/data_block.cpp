@@ -1,7 +1,9 @@
 #include "data_block.h"
+#include "direct_io.h"
 #include "document.h"
 #include "common.h"
 #include "dump.h"
+#include "trace.h"
 #include <cstring>
 
 #include <multiverso/log.h>
@@ -12,10 +14,22 @@
 #include <Windows.h>
 #else 
 #include <stdio.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #endif
 
 namespace
 {
+    /*! \brief number of topics gathered per write to the side file */
+    const int64_t kTopicChunkSize = 1 << 20;
+
+    std::string TopicFileName(const std::string& block_file)
+    {
+        return block_file + ".topics";
+    }
+
     void AtomicMoveFileExA(std::string existing_file, std::string new_file)
     {
 #if defined(_WIN32) || defined(_WIN64)
@@ -32,13 +46,35 @@ namespace
 
 namespace multiverso { namespace lightlda
 {
-    DataBlock::DataBlock()
-        : has_read_(false), num_document_(0), corpus_size_(0), vocab_(nullptr)
+    DataBlock::DataBlock(bool write_back)
+        : has_read_(false), write_back_(write_back), use_mmap_(false),
+        mapped_(nullptr), mapped_size_(0), use_direct_(false),
+        image_(nullptr), image_capacity_(0), num_document_(0),
+        offset_buffer_(nullptr), corpus_size_(0), documents_buffer_(nullptr),
+        vocab_(nullptr)
     {
         max_num_document_ = Config::max_num_document;
         memory_block_size_ = Config::data_capacity / sizeof(int32_t);
+#if !defined(_WIN32) && !defined(_WIN64)
+        use_mmap_ = Config::mmap_data;
+        use_direct_ = !use_mmap_ && Config::io_engine == "direct";
+#endif
+        // Mapped blocks take their size from the file header
+        if (!use_mmap_) AllocateBuffers();
+    }
 
-        documents_.resize(max_num_document_);
+    void DataBlock::AllocateBuffers()
+    {
+        if (use_direct_)
+        {
+            // same capacity as the pools below, laid out as the block file
+            image_capacity_ = sizeof(DocNumber) +
+                sizeof(int64_t)* max_num_document_ +
+                sizeof(int32_t)* memory_block_size_;
+            image_ = DirectIO::Allocate(image_capacity_);
+            offset_buffer_ = reinterpret_cast<int64_t*>(image_) + 1;
+            return;
+        }
         
         try{
             offset_buffer_ = new int64_t[max_num_document_];
@@ -57,13 +93,30 @@ namespace multiverso { namespace lightlda
 
     DataBlock::~DataBlock()
     {
-        delete[] offset_buffer_;
-        delete[] documents_buffer_;
+        if (mapped_ != nullptr)
+        {
+            Unmap();
+        }
+        else if (image_ != nullptr)
+        {
+            DirectIO::Free(image_);
+        }
+        else
+        {
+            delete[] offset_buffer_;
+            delete[] documents_buffer_;
+        }
     }
 
     void DataBlock::Read(dump *dmp)
     {
+        if (mapped_ != nullptr) Unmap();
+        if (offset_buffer_ == nullptr) AllocateBuffers();
 		num_document_ = 1;
+        if (use_direct_)
+        {
+            documents_buffer_ = reinterpret_cast<int32_t*>(offset_buffer_ + 2);
+        }
 		offset_buffer_[0] = 0;
 		offset_buffer_[1] = dmp -> get_doc_buf_size();  
         corpus_size_ = offset_buffer_[num_document_];
@@ -72,13 +125,28 @@ namespace multiverso { namespace lightlda
 
 		//documents_buffer_ = dmp.get_doc_buf();
 
-        GenerateDocuments();
         has_read_ = true;
     }
 
 	void DataBlock::Read(std::string file_name)
 	{
+        TRACE_SCOPE("DataBlock::Read");
         file_name_ = file_name;
+        if (use_mmap_)
+        {
+            MapFile();
+            if (Config::topic_file) ReadTopics();
+            has_read_ = true;
+            return;
+        }
+        if (use_direct_)
+        {
+            ParseImage(image_,
+                DirectIO::ReadFile(file_name_, image_, image_capacity_));
+            if (Config::topic_file) ReadTopics();
+            has_read_ = true;
+            return;
+        }
         std::ifstream block_file(file_name_, std::ios::in | std::ios::binary);
         if (!block_file.good())
         {
@@ -108,14 +176,44 @@ namespace multiverso { namespace lightlda
             sizeof(int32_t)* corpus_size_);
         block_file.close();
 
-        GenerateDocuments();
+        if (Config::topic_file) ReadTopics();
         has_read_ = true;
     }
 
 
     void DataBlock::Write()
     {
+        TRACE_SCOPE("DataBlock::Write");
+        if (Config::topic_file)
+        {
+            WriteTopics();
+            if (mapped_ != nullptr) Unmap();
+            has_read_ = false;
+            return;
+        }
+#if !defined(_WIN32) && !defined(_WIN64)
+        if (mapped_ != nullptr && write_back_)
+        {
+            // topics are updated in place through the shared mapping, only
+            // schedule the dirty pages for writeback
+            msync(mapped_, mapped_size_, MS_ASYNC);
+            Unmap();
+            has_read_ = false;
+            return;
+        }
+#endif
         std::string temp_file = file_name_ + ".temp";
+        if (use_direct_)
+        {
+            // the image is the block file, only its header may be stale
+            *reinterpret_cast<DocNumber*>(image_) = num_document_;
+            DirectIO::WriteFile(temp_file, image_,
+                sizeof(DocNumber) + sizeof(int64_t)* (num_document_ + 1) +
+                sizeof(int32_t)* corpus_size_);
+            AtomicMoveFileExA(temp_file, file_name_);
+            has_read_ = false;
+            return;
+        }
 
         std::ofstream block_file(temp_file, std::ios::out | std::ios::binary);
 
@@ -134,17 +232,155 @@ namespace multiverso { namespace lightlda
         block_file.close();
 
         AtomicMoveFileExA(temp_file, file_name_);
+        if (mapped_ != nullptr) Unmap();
         has_read_ = false;
     }
 
-    void DataBlock::GenerateDocuments()
+    void DataBlock::MapFile()
+    {
+#if !defined(_WIN32) && !defined(_WIN64)
+        if (mapped_ != nullptr) Unmap();
+        // with side files for topics, the block file itself is never written
+        bool shared = write_back_ && !Config::topic_file;
+        int fd = open(file_name_.c_str(), shared ? O_RDWR : O_RDONLY);
+        struct stat file_stat;
+        if (fd == -1 || fstat(fd, &file_stat) == -1)
+        {
+            Log::Fatal("Failed to read data %s\n", file_name_.c_str());
+        }
+        mapped_size_ = file_stat.st_size;
+        if (mapped_size_ == 0)
+        {
+            Log::Fatal("Rank %d: invalid block file %s\n",
+                Multiverso::ProcessRank(), file_name_.c_str());
+        }
+        // Private mappings still allow the trainers to update topics, the
+        // changes are just never written to the file
+        mapped_ = mmap(nullptr, mapped_size_, PROT_READ | PROT_WRITE,
+            shared ? MAP_SHARED : MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (mapped_ == MAP_FAILED)
+        {
+            mapped_ = nullptr;
+            Log::Fatal("Rank %d: failed to map file %s\n",
+                Multiverso::ProcessRank(), file_name_.c_str());
+        }
+        madvise(mapped_, mapped_size_, MADV_SEQUENTIAL);
+        madvise(mapped_, mapped_size_, MADV_WILLNEED);
+#ifdef MADV_HUGEPAGE
+        // only a hint, file-backed mappings may not support huge pages
+        madvise(mapped_, mapped_size_, MADV_HUGEPAGE);
+#endif
+        ParseImage(mapped_, mapped_size_);
+#endif
+    }
+
+    void DataBlock::ParseImage(void* image, int64_t size)
+    {
+        int64_t* header = reinterpret_cast<int64_t*>(image);
+        num_document_ = size < static_cast<int64_t>(2 * sizeof(int64_t))
+            ? -1 : header[0];
+        int64_t header_size = (num_document_ + 2) * sizeof(int64_t);
+        if (num_document_ < 0 || header_size > size)
+        {
+            Log::Fatal("Rank %d: invalid block file %s\n",
+                Multiverso::ProcessRank(), file_name_.c_str());
+        }
+        offset_buffer_ = header + 1;
+        corpus_size_ = offset_buffer_[num_document_];
+        if (header_size + corpus_size_ * static_cast<int64_t>(sizeof(int32_t))
+            != size)
+        {
+            Log::Fatal("Rank %d: size of file %s mismatches its header\n",
+                Multiverso::ProcessRank(), file_name_.c_str());
+        }
+        documents_buffer_ = reinterpret_cast<int32_t*>(
+            reinterpret_cast<char*>(image) + header_size);
+    }
+
+    void DataBlock::ReadTopics()
     {
-        for (int32_t index = 0; index < num_document_; ++index)
+        std::string topic_file = TopicFileName(file_name_);
+        std::ifstream file(topic_file, std::ios::in | std::ios::binary);
+        // no side file before the first write back, keep topics of block
+        if (!file.good()) return;
+
+        int64_t num_tokens = 0;
+        file.read(reinterpret_cast<char*>(&num_tokens), sizeof(int64_t));
+        if (num_tokens != (corpus_size_ - num_document_) / 2)
         {
-            documents_[index].reset(new Document(
-                documents_buffer_ + offset_buffer_[index],
-                documents_buffer_ + offset_buffer_[index + 1]));
+            Log::Fatal("Rank %d: %s mismatches tokens of block %s\n",
+                Multiverso::ProcessRank(), topic_file.c_str(),
+                file_name_.c_str());
         }
+        std::vector<int32_t> topics(kTopicChunkSize);
+        int64_t count = 0;
+        for (DocNumber i = 0; i < num_document_; ++i)
+        {
+            for (int64_t pos = offset_buffer_[i] + 2;
+                pos < offset_buffer_[i + 1]; pos += 2)
+            {
+                if (count % kTopicChunkSize == 0)
+                {
+                    int64_t size = num_tokens - count < kTopicChunkSize ?
+                        num_tokens - count : kTopicChunkSize;
+                    file.read(reinterpret_cast<char*>(topics.data()),
+                        sizeof(int32_t)* size);
+                }
+                documents_buffer_[pos] = topics[count % kTopicChunkSize];
+                ++count;
+            }
+        }
+        if (!file.good())
+        {
+            Log::Fatal("Failed to read topics %s\n", topic_file.c_str());
+        }
+    }
+
+    void DataBlock::WriteTopics()
+    {
+        std::string topic_file = TopicFileName(file_name_);
+        std::string temp_file = topic_file + ".temp";
+        std::ofstream file(temp_file, std::ios::out | std::ios::binary);
+        if (!file.good())
+        {
+            Log::Fatal("Failed to open file %s\n", temp_file.c_str());
+        }
+
+        int64_t num_tokens = (corpus_size_ - num_document_) / 2;
+        file.write(reinterpret_cast<char*>(&num_tokens), sizeof(int64_t));
+        std::vector<int32_t> topics(kTopicChunkSize);
+        int64_t count = 0;
+        for (DocNumber i = 0; i < num_document_; ++i)
+        {
+            for (int64_t pos = offset_buffer_[i] + 2;
+                pos < offset_buffer_[i + 1]; pos += 2)
+            {
+                topics[count % kTopicChunkSize] = documents_buffer_[pos];
+                if (++count % kTopicChunkSize == 0)
+                {
+                    file.write(reinterpret_cast<char*>(topics.data()),
+                        sizeof(int32_t)* kTopicChunkSize);
+                }
+            }
+        }
+        file.write(reinterpret_cast<char*>(topics.data()),
+            sizeof(int32_t)* (count % kTopicChunkSize));
+        file.flush();
+        file.close();
+
+        AtomicMoveFileExA(temp_file, topic_file);
+    }
+
+    void DataBlock::Unmap()
+    {
+#if !defined(_WIN32) && !defined(_WIN64)
+        munmap(mapped_, mapped_size_);
+#endif
+        mapped_ = nullptr;
+        mapped_size_ = 0;
+        offset_buffer_ = nullptr;
+        documents_buffer_ = nullptr;
     }
 } // namespace lightlda
 } // namespace multiverso
@@ -2,11 +2,17 @@
 #include "common.h"
 #include "data_block.h"
 #include "dump.h"
+#include "metrics.h"
+#include "trace.h"
 
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
 #include <vector>
 #include <thread>
 
-#include <multiverso/double_buffer.h>
+#include <multiverso/log.h>
 
 namespace multiverso { namespace lightlda
 {
@@ -29,34 +35,47 @@ namespace multiverso { namespace lightlda
         void operator=(const MemoryDataStream&);
     };
 
+    /*!
+     * \brief DiskDataStream keeps a ring of block buffers for out of core
+     *  computing. A reader thread loads blocks into free buffers ahead of
+     *  training and a writer thread writes trained blocks back, so that
+     *  reading, training and write-back overlap.
+     */
     class DiskDataStream : public IDataStream
     {
-        typedef DoubleBuffer<DataBlock> DataBuffer;
     public:
-        DiskDataStream(int32_t num_blocks, std::string data_path,
-            int32_t num_iterations);
+        DiskDataStream(int32_t num_blocks, std::string data_path);
         virtual ~DiskDataStream();
         virtual void BeforeDataAccess() override;
         virtual void EndDataAccess() override;
         virtual DataBlock& CurrDataBlock() override;
     private:
-        /*! \brief Background data thread entrance function */
-        void DataPreloadMain();
-        /*! \brief buffer for data */
-        DataBlock* buffer_0;
-        DataBlock* buffer_1;
-        DataBuffer* data_buffer_;
-        /*! \brief current block id to be accessed */
-        int32_t block_id_;
+        /*! \brief State of one buffer in the ring */
+        enum class BufferState { Empty, Ready, InUse, Dirty };
+        /*! \brief Background thread loading blocks into empty buffers */
+        void ReaderMain();
+        /*! \brief Background thread writing trained blocks back to disk */
+        void WriterMain();
+        /*! \brief ring of block buffers, access i uses buffer i % size */
+        std::vector<DataBlock*> buffers_;
+        std::vector<BufferState> states_;
+        /*! \brief max number of ready blocks ahead of training */
+        int32_t prefetch_depth_;
+        /*! \brief number of block accesses begun by training */
+        int64_t num_accessed_;
         /*! \brief number of data blocks in disk */
         int32_t num_blocks_;
-        /*! \brief number of training iterations */
-        int32_t num_iterations_;
         /*! \brief data path */
         std::string data_path_;
-        /*! \brief backend thread for data preload */
-        std::thread preload_thread_;
-        bool working_;
+        /*! \brief accumulated time of training, reader and writer on I/O */
+        double stall_seconds_;
+        double read_seconds_;
+        double write_seconds_;
+        bool stop_;
+        std::mutex mutex_;
+        std::condition_variable cond_;
+        std::thread reader_thread_;
+        std::thread writer_thread_;
 
         // No copying allowed
         DiskDataStream(const DiskDataStream&);
@@ -114,89 +133,141 @@ namespace multiverso { namespace lightlda
     }
 
     DiskDataStream::DiskDataStream(int32_t num_blocks,
-        std::string data_path, int32_t num_iterations) :
-        num_blocks_(num_blocks), data_path_(data_path),
-        num_iterations_(num_iterations), working_(false)
-    {
-        block_id_ = 0;
-        buffer_0 = new DataBlock();
-        buffer_1 = new DataBlock();
-        data_buffer_ = new DataBuffer(1, buffer_0, buffer_1);
-        preload_thread_ = std::thread(&DiskDataStream::DataPreloadMain, this);
-        while (!working_)
+        std::string data_path) :
+        num_accessed_(0), num_blocks_(num_blocks), data_path_(data_path),
+        stall_seconds_(0.0), read_seconds_(0.0), write_seconds_(0.0),
+        stop_(false)
+    {
+        // a block can't be read again before its last write-back is done,
+        // so more buffers than blocks never help
+        int32_t num_buffers = std::max(2,
+            std::min(Config::prefetch_buffers, num_blocks_));
+        prefetch_depth_ = Config::prefetch_depth;
+        if (prefetch_depth_ <= 0 || prefetch_depth_ > num_buffers - 1)
+        {
+            prefetch_depth_ = num_buffers - 1;
+        }
+        Log::Info("Out of core data stream: %d buffers, prefetch depth %d\n",
+            num_buffers, prefetch_depth_);
+
+        buffers_.resize(num_buffers, nullptr);
+        states_.resize(num_buffers, BufferState::Empty);
+        for (auto& buffer : buffers_)
         {
-            std::this_thread::sleep_for(std::chrono::microseconds(10));
+            buffer = new DataBlock(true);
         }
+        reader_thread_ = std::thread(&DiskDataStream::ReaderMain, this);
+        writer_thread_ = std::thread(&DiskDataStream::WriterMain, this);
     }
 
     DiskDataStream::~DiskDataStream()
     {
-        preload_thread_.join();
-        if (data_buffer_ != nullptr)
         {
-            delete data_buffer_;
-            data_buffer_ = nullptr;
-            delete buffer_1;
-            buffer_1 = nullptr;
-            delete buffer_0;
-            buffer_0 = nullptr;
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        cond_.notify_all();
+        reader_thread_.join();
+        writer_thread_.join();
+        Log::Info("Out of core data stream: %lld block accesses, stalled "
+            "%.3fs, read %.3fs, write %.3fs\n",
+            static_cast<long long>(num_accessed_), stall_seconds_,
+            read_seconds_, write_seconds_);
+        for (auto& buffer : buffers_)
+        {
+            delete buffer;
+            buffer = nullptr;
         }
     }
 
     DataBlock& DiskDataStream::CurrDataBlock()
     {
-        return data_buffer_->WorkerBuffer();
+        return *buffers_[(num_accessed_ - 1) % buffers_.size()];
     }
 
     void DiskDataStream::BeforeDataAccess()
     {
-        data_buffer_->Start(1);
+        size_t index = num_accessed_ % buffers_.size();
+        auto start = std::chrono::steady_clock::now();
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cond_.wait(lock, [&]{ return states_[index] == BufferState::Ready; });
+            states_[index] = BufferState::InUse;
+            ++num_accessed_;
+        }
+        cond_.notify_all();
+        double stall = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start).count();
+        stall_seconds_ += stall;
+        Metrics::RecordIOStall(stall);
     }
 
     void DiskDataStream::EndDataAccess()
     {
-        data_buffer_->End(1);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            states_[(num_accessed_ - 1) % buffers_.size()] = BufferState::Dirty;
+        }
+        cond_.notify_all();
+    }
+
+    void DiskDataStream::ReaderMain()
+    {
+        // access i reads block i % num_blocks, until the stream is closed
+        for (int64_t i = 0; ; ++i)
+        {
+            size_t index = i % buffers_.size();
+            {
+                TRACE_SCOPE("DataStream::WaitBuffer");
+                std::unique_lock<std::mutex> lock(mutex_);
+                cond_.wait(lock, [&]{ return stop_ ||
+                    (states_[index] == BufferState::Empty &&
+                    i < num_accessed_ + prefetch_depth_); });
+                if (stop_) return;
+            }
+            int32_t block_id = static_cast<int32_t>(i % num_blocks_);
+            auto start = std::chrono::steady_clock::now();
+            buffers_[index]->Read(data_path_ + "/block."
+                + std::to_string(block_id));
+            read_seconds_ += std::chrono::duration<double>(
+                std::chrono::steady_clock::now() - start).count();
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                states_[index] = BufferState::Ready;
+            }
+            cond_.notify_all();
+        }
     }
 
-    void DiskDataStream::DataPreloadMain()
+    void DiskDataStream::WriterMain()
     {
-        int32_t block_id = 0;
-        std::string block_file = data_path_ + "/block."
-            + std::to_string(block_id);
-        data_buffer_->Start(0);
-        data_buffer_->IOBuffer().Read(block_file);
-        data_buffer_->End(0);
-        working_ = true;
-        for (int32_t iter = 0; iter <= num_iterations_; ++iter)
+        for (int64_t i = 0; ; ++i)
         {
-            for (int32_t block_id = 0; block_id < num_blocks_; ++block_id)
+            size_t index = i % buffers_.size();
             {
-                data_buffer_->Start(0);
-
-                DataBlock& data_block = data_buffer_->IOBuffer();
-                if (data_block.HasLoad())
-                {
-                    data_block.Write();
-                }
-                if (iter == num_iterations_ && block_id == num_blocks_ - 1)
-                {
-                    break;
-                }
-                // Load New data;
-                int32_t next_block_id = (block_id + 1) % num_blocks_;
-                block_file = data_path_ + "/block." + 
-                    std::to_string(next_block_id);
-                data_block.Read(block_file);
-                data_buffer_->End(0);
+                std::unique_lock<std::mutex> lock(mutex_);
+                // training has finished once stopped, so drain dirty buffers
+                cond_.wait(lock, [&]{ return stop_ ||
+                    states_[index] == BufferState::Dirty; });
+                if (states_[index] != BufferState::Dirty) return;
             }
+            auto start = std::chrono::steady_clock::now();
+            buffers_[index]->Write();
+            write_seconds_ += std::chrono::duration<double>(
+                std::chrono::steady_clock::now() - start).count();
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                states_[index] = BufferState::Empty;
+            }
+            cond_.notify_all();
         }
     }
+
     IDataStream* CreateDataStream()
     {
         if (Config::out_of_core && Config::num_blocks != 1)
         {
-            return new DiskDataStream(Config::num_blocks, Config::input_dir,
-                Config::num_iterations);
+            return new DiskDataStream(Config::num_blocks, Config::input_dir);
         }
         else
         {
@@ -208,8 +279,7 @@ namespace multiverso { namespace lightlda
     {
         if (Config::out_of_core && Config::num_blocks != 1)
         {
-            return new DiskDataStream(Config::num_blocks, Config::input_dir,
-                Config::num_iterations);
+            return new DiskDataStream(Config::num_blocks, Config::input_dir);
         }
         else
         {
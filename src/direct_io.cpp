@@ -0,0 +1,187 @@
+#include "direct_io.h"
+
+#include <multiverso/log.h>
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#if defined(_WIN32) || defined(_WIN64)
+#include <malloc.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    /*! \brief size of one read or write request */
+    const int64_t kChunkSize = 8 << 20;
+    /*! \brief max number of requests in flight */
+    const int32_t kNumIOThreads = 4;
+
+#if !defined(_WIN32) && !defined(_WIN64)
+    /*!
+     * \brief Opens file with O_DIRECT if the file system supports it
+     * \param direct set to whether O_DIRECT is used
+     */
+    int OpenFile(const std::string& file_name, int flags, bool& direct)
+    {
+        direct = false;
+#ifdef O_DIRECT
+        int fd = open(file_name.c_str(), flags | O_DIRECT, 0644);
+        if (fd != -1 || errno != EINVAL)
+        {
+            direct = fd != -1;
+            return fd;
+        }
+#endif
+        return open(file_name.c_str(), flags, 0644);
+    }
+
+    /*!
+     * \brief Reads or writes [0, size) of fd in chunks from several threads
+     * \return false if any request failed
+     */
+    bool Transfer(int fd, char* buffer, int64_t size, bool is_write)
+    {
+        int64_t num_chunks = (size + kChunkSize - 1) / kChunkSize;
+        std::atomic<int64_t> next_chunk(0);
+        std::atomic<bool> succeed(true);
+        auto worker = [&]()
+        {
+            for (int64_t chunk = next_chunk++; chunk < num_chunks && succeed;
+                chunk = next_chunk++)
+            {
+                int64_t offset = chunk * kChunkSize;
+                int64_t end = std::min(offset + kChunkSize, size);
+                while (offset < end)
+                {
+                    ssize_t count = is_write
+                        ? pwrite(fd, buffer + offset, end - offset, offset)
+                        : pread(fd, buffer + offset, end - offset, offset);
+                    if (count < 0 && errno == EINTR) continue;
+                    // reads of the aligned tail stop at end of file
+                    if (count == 0 && !is_write) break;
+                    if (count <= 0)
+                    {
+                        succeed = false;
+                        break;
+                    }
+                    offset += count;
+                }
+            }
+        };
+        int64_t num_threads = std::min<int64_t>(kNumIOThreads, num_chunks);
+        std::vector<std::thread> threads;
+        for (int64_t i = 1; i < num_threads; ++i)
+        {
+            threads.emplace_back(worker);
+        }
+        worker();
+        for (auto& thread : threads) thread.join();
+        return succeed;
+    }
+#endif
+}
+
+namespace multiverso { namespace lightlda
+{
+    int64_t DirectIO::Align(int64_t size)
+    {
+        return (size + kAlignment - 1) / kAlignment * kAlignment;
+    }
+
+    void* DirectIO::Allocate(int64_t size)
+    {
+        void* buffer = nullptr;
+#if defined(_WIN32) || defined(_WIN64)
+        buffer = _aligned_malloc(Align(size), kAlignment);
+#else
+        if (posix_memalign(&buffer, kAlignment, Align(size)) != 0)
+        {
+            buffer = nullptr;
+        }
+#endif
+        if (buffer == nullptr)
+        {
+            Log::Fatal("Failed to allocate %lld bytes of aligned memory\n",
+                static_cast<long long>(size));
+        }
+        return buffer;
+    }
+
+    void DirectIO::Free(void* buffer)
+    {
+#if defined(_WIN32) || defined(_WIN64)
+        _aligned_free(buffer);
+#else
+        free(buffer);
+#endif
+    }
+
+    int64_t DirectIO::ReadFile(const std::string& file_name, void* buffer,
+        int64_t capacity)
+    {
+#if defined(_WIN32) || defined(_WIN64)
+        Log::Fatal("Direct I/O is not supported on Windows\n");
+        return 0;
+#else
+        bool direct = false;
+        int fd = OpenFile(file_name, O_RDONLY, direct);
+        struct stat file_stat;
+        if (fd == -1 || fstat(fd, &file_stat) == -1)
+        {
+            Log::Fatal("Failed to read data %s\n", file_name.c_str());
+        }
+        int64_t size = file_stat.st_size;
+        if (size > capacity)
+        {
+            Log::Fatal("Size of file %s exceeds buffer of %lld bytes\n",
+                file_name.c_str(), static_cast<long long>(capacity));
+        }
+        if (!Transfer(fd, static_cast<char*>(buffer),
+            direct ? Align(size) : size, false))
+        {
+            Log::Fatal("Failed to read data %s\n", file_name.c_str());
+        }
+        if (!direct) posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+        return size;
+#endif
+    }
+
+    void DirectIO::WriteFile(const std::string& file_name,
+        const void* buffer, int64_t size)
+    {
+#if defined(_WIN32) || defined(_WIN64)
+        Log::Fatal("Direct I/O is not supported on Windows\n");
+#else
+        bool direct = false;
+        int fd = OpenFile(file_name, O_WRONLY | O_CREAT | O_TRUNC, direct);
+        if (fd == -1)
+        {
+            Log::Fatal("Failed to open file %s\n", file_name.c_str());
+        }
+        // O_DIRECT writes whole aligned chunks, the padding is cut off after
+        if (!Transfer(fd, static_cast<char*>(const_cast<void*>(buffer)),
+            direct ? Align(size) : size, true) ||
+            (direct && ftruncate(fd, size) == -1))
+        {
+            Log::Fatal("Failed to write file %s\n", file_name.c_str());
+        }
+        if (!direct)
+        {
+            // dirty pages can only be dropped once they are on disk
+            fdatasync(fd);
+            posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        }
+        close(fd);
+#endif
+    }
+} // namespace lightlda
+} // namespace multiverso
@@ -5,7 +5,7 @@
 namespace multiverso { namespace lightlda
 {
     Document::Document(int32_t* begin, int32_t* end)
-        : begin_(begin), end_(end), cursor_(*begin_)
+        : begin_(begin), end_(end)
     {}
 
     void Document::GetDocTopicVector(Row<int32_t>& topic_counter)
@@ -20,6 +20,7 @@ namespace multiverso { namespace lightlda
      *  would interpret a contiguous piece of extern memory as a document
      *  with the format :
      *  #cursor, word1, topic1, word2, topic2, ..., wordn, topicn.#
+     *  Document is a cheap value type, copies view the same memory.
      */
     class Document
     {
@@ -43,11 +44,6 @@ namespace multiverso { namespace lightlda
     private:
         int32_t* begin_;
         int32_t* end_;
-        int32_t& cursor_;
-
-        // No copying allowed
-        Document(const Document&);
-        void operator=(const Document&);
     };
 
     // -- inline functions definition area --------------------------------- //
@@ -63,7 +59,7 @@ namespace multiverso { namespace lightlda
     {
         return *(begin_ + 2 + index * 2);
     }
-    inline int32_t& Document::Cursor() { return cursor_; }
+    inline int32_t& Document::Cursor() { return *begin_; }
     inline void Document::SetTopic(int32_t index, int32_t topic)
     {
         *(begin_ + 2 + index * 2) = topic;
@@ -1,5 +1,6 @@
 #include "dump.h"
 #include "common.h"
+#include "text_parser.h"
 #include <multiverso/stop_watch.h>
 
 using namespace multiverso::lightlda;
@@ -23,7 +24,7 @@ bool utf8_stream::open(const std::string& file_name)
 
 bool utf8_stream::getline(std::string& line)
 {
-    line = "";
+    line.clear();
     while (true)
     {
         if (block_is_empty())
@@ -40,18 +41,20 @@ bool utf8_stream::getline(std::string& line)
         }
         // the block is not empty now
 
-        std::string::size_type end_pos = block_buf_.find("\n", buf_idx_);
-        if (end_pos != std::string::npos)
+        const char* buffer = block_buf_.data();
+        std::string::size_type end_pos = TextParser::Find(
+            buffer + buf_idx_, buffer + buf_end_, '\n') - buffer;
+        if (end_pos != buf_end_)
         {
             // successfully find a new line
-            line += block_buf_.substr(buf_idx_, end_pos - buf_idx_);
+            line.append(block_buf_, buf_idx_, end_pos - buf_idx_);
             buf_idx_ = end_pos + 1;
             return true;
         }
         else
         {
             // do not find an \n untile the end of block_buf_
-            line += block_buf_.substr(buf_idx_, buf_end_ - buf_idx_);
+            line.append(block_buf_, buf_idx_, buf_end_ - buf_idx_);
             buf_idx_ = buf_end_;
         }
     }
@@ -137,16 +140,16 @@ void dump::load_global_tf(std::string word_tf_file)
     std::string line;
     while (stream.getline(line))
     {
-        std::vector<std::string> output;
-        split_string(line, '\t', output);
-        if (output.size() != 3)
+        TextView fields[3];
+        int32_t word_id, tf;
+        if (TextParser::Split(TextParser::TrimRight(TextView(line)), '\t',
+            fields, 3) != 3 || !TextParser::ParseInt(fields[0], word_id) ||
+            !TextParser::ParseInt(fields[2], tf) || word_id >= Config::num_vocabs)
         {
             std::cout << "Invalid line: " << line << std::endl;
             exit(1);
         }
-        int32_t word_id = std::stoi(output[0]);
-		std::string word = output[1];
-        int32_t tf = std::stoi(output[2]);
+		std::string word = fields[1].ToString();
         auto it = global_tf_map[word_id];
         if (it != 0)
         {
@@ -183,34 +186,37 @@ void dump::load_word_topic(std::string word_topic_file)
     std::string line;
     while (stream.getline(line))
     {
-        std::vector<std::string> output;
-        split_string(line, ' ', output);
-
-        int32_t word_id = std::stoi(output[0]);
+        TextView text = TextParser::TrimRight(TextView(line));
+        const char* ptr = text.begin;
+        int32_t word_id;
+        if (!TextParser::ParseInt(ptr, text.end, word_id) ||
+            word_id >= Config::num_vocabs)
+        {
+            std::cout << "format error!" << std::endl;
+            exit(0);
+        }
 
 		std::vector<Topic_token> topic_tokens;
 		int32_t topic_id = 0;
 		int32_t topic_freq = 0;
 
-        if(output.size() < 2)
+        if(ptr == text.end)
         {
             std::cout << "this word has no topic related or format error!" << std::endl;
             exit(0);
         }
 
-		for(int32_t i = 1; i < output.size(); i++)
+		while (ptr < text.end)
 		{
-			std::vector<std::string> t_f;
-			split_string(output[i], ':', t_f);
-
-            if(t_f.size() < 2)
+			int32_t topic, freq;
+            if (*ptr++ != ' ' || !TextParser::ParseInt(ptr, text.end, topic) ||
+                ptr == text.end || *ptr++ != ':' ||
+                !TextParser::ParseInt(ptr, text.end, freq) ||
+                topic >= static_cast<int32_t>(topic_summary.size()))
             {
                 std::cout << "format error!" << std::endl;
                 exit(0);
             }
-   
-			int32_t topic = std::stoi(t_f[0]);
-			int32_t freq = std::stoi(t_f[1]);
 
 			//caculate the topic has been show up in total
 			topic_summary[topic] += freq;
@@ -4,6 +4,7 @@
 
 #include "common.h"
 #include "document.h"
+#include "row_cache.h"
 #include "trainer.h"
 
 #include <multiverso/row.h>
@@ -58,8 +59,8 @@ namespace multiverso { namespace lightlda
 
     double Eval::ComputeOneWordLLH(int32_t word, Trainer* trainer)
     {
-        Row<int32_t>& params = trainer->GetRow<int32_t>(
-            kWordTopicTable, word);
+        Row<int32_t>& params = RowCache::resident() ? RowCache::GetRow(word) :
+            trainer->GetRow<int32_t>(kWordTopicTable, word);
         if (params.NonzeroSize() == 0) return 0.0;
         double word_llh = 0.0;
         int32_t nonzero_num = 0;
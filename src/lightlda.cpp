@@ -1,19 +1,29 @@
 ﻿#include "common.h"
 #include "trainer.h"
 #include "alias_table.h"
+#include "checkpoint.h"
 #include "data_stream.h"
 #include "data_block.h"
 #include "document.h"
 #include "meta.h"
+#include "metrics.h"
+#include "row_cache.h"
+#include "trace.h"
 #include "util.h"
+#include <algorithm>
 #include <vector>
 #include <iostream>
+#include <memory>
+#include <thread>
 #include <multiverso/barrier.h>
 #include <multiverso/log.h>
 #include <multiverso/row.h>
 
 namespace multiverso { namespace lightlda
 {     
+    /*! \brief Keys a thread of LightLDA::InitSlice buffers before merging */
+    const size_t kInitKeys = 1 << 20;
+
     class LightLDA
     {
     public:
@@ -24,6 +34,8 @@ namespace multiverso { namespace lightlda
             AliasTable* alias_table = new AliasTable();
             Barrier* barrier = new Barrier(Config::num_local_workers);
             meta.Init();
+            Checkpoint::Init(meta);
+            RowCache::Init(meta);
             std::vector<TrainerBase*> trainers;
             for (int32_t i = 0; i < Config::num_local_workers; ++i)
             {
@@ -41,12 +53,18 @@ namespace multiverso { namespace lightlda
 
             Log::ResetLogFile("LightLDA."
                 + std::to_string(clock()) + ".log");
+            Metrics::Init(Multiverso::ProcessRank());
+            Tracer::Init(Multiverso::ProcessRank());
+            CheckpointQueue::Start();
 
             data_stream = CreateDataStream();
             InitMultiverso();
             Train();
 
+            // the last checkpoint is complete once its writes are drained
+            CheckpointQueue::Close();
             Multiverso::Close();
+            Metrics::Close();
             
             for (auto& trainer : trainers)
             {
@@ -59,18 +77,24 @@ namespace multiverso { namespace lightlda
             delete data_stream;
             delete barrier;
             delete alias_table;
+
+            // Every thread recording events has finished by now
+            Tracer::Close();
         }
     private:
         static void Train()
         {
             Multiverso::BeginTrain();
-            for (int32_t i = 0; i < Config::num_iterations; ++i)
+            for (int32_t i = start_iteration; i < Config::num_iterations; ++i)
             {
                 Multiverso::BeginClock();
                 // Train corpus block by block
                 for (int32_t block = 0; block < Config::num_blocks; ++block)
                 {
-                    data_stream->BeforeDataAccess();
+                    {
+                        TRACE_SCOPE("WaitDataBlock", block);
+                        data_stream->BeforeDataAccess();
+                    }
                     DataBlock& data_block = data_stream->CurrDataBlock();
                     data_block.set_meta(&meta.local_vocab(block));
                     int32_t num_slice = meta.local_vocab(block).num_slice();
@@ -85,7 +109,10 @@ namespace multiverso { namespace lightlda
                         lda_block->set_slice(slice);
                         Multiverso::PushDataBlock(lda_block);
                     }
-                    Multiverso::Wait();
+                    {
+                        TRACE_SCOPE("TrainBlock", block);
+                        Multiverso::Wait();
+                    }
                     data_stream->EndDataAccess();
                 }
                 Multiverso::EndClock();
@@ -104,7 +131,14 @@ namespace multiverso { namespace lightlda
 
         static void Initialize()
         {
-            xorshift_rng rng;
+            if (!Config::resume_dir.empty() && Resume()) return;
+            std::vector<std::unique_ptr<xorshift_rng>> rngs;
+            uint32_t seed = static_cast<uint32_t>(time(nullptr));
+            for (int32_t i = 0; i < Config::num_local_workers; ++i)
+            {
+                rngs.emplace_back(new xorshift_rng(seed + 0x9E3779B9u * i));
+            }
+            std::vector<int64_t> summary(Config::num_topics, 0);
             for (int32_t block = 0; block < Config::num_blocks; ++block)
             {
                 data_stream->BeforeDataAccess();
@@ -112,29 +146,211 @@ namespace multiverso { namespace lightlda
                 int32_t num_slice = meta.local_vocab(block).num_slice();
                 for (int32_t slice = 0; slice < num_slice; ++slice)
                 {
-                    for (int32_t i = 0; i < data_block.Size(); ++i)
+                    InitSlice(data_block, meta.local_vocab(block), slice,
+                        rngs, summary);
+                }
+                data_stream->EndDataAccess();
+            }
+            for (int32_t topic = 0; topic < Config::num_topics; ++topic)
+            {
+                if (summary[topic] != 0)
+                {
+                    Multiverso::AddToServer<int64_t>(kSummaryRow,
+                        0, topic, summary[topic]);
+                }
+            }
+            Multiverso::Flush();
+        }
+
+        /*!
+         * \brief Initializes the topics of the tokens of a slice and adds
+         *  them to the word-topic table. Docs are split across threads, each
+         *  counting its (word, topic) pairs, so every non-zero entry of a
+         *  row is pushed once instead of once per token. Pairs are buffered
+         *  up to kInitKeys or the size of the counts of the thread, then
+         *  sorted and merged into them, so the memory is bounded by the
+         *  non-zero entries of the slice rather than by its tokens
+         * \param summary accumulates the count of each topic
+         */
+        static void InitSlice(DataBlock& data_block, const LocalVocab& vocab,
+            int32_t slice, std::vector<std::unique_ptr<xorshift_rng>>& rngs,
+            std::vector<int64_t>& summary)
+        {
+            TRACE_SCOPE("InitSlice", slice);
+            int32_t num_parts = static_cast<int32_t>(rngs.size());
+            int32_t last_word = vocab.LastWord(slice);
+            bool random_topic = !Config::warm_start && Config::resume_dir.empty();
+            // sorted (word << 32 | topic, count) of the docs of each part
+            std::vector<std::vector<std::pair<uint64_t, int32_t>>>
+                counts(num_parts);
+            auto count_part = [&](int32_t part)
+            {
+                int32_t doc_begin = static_cast<int32_t>(
+                    static_cast<int64_t>(data_block.Size()) * part / num_parts);
+                int32_t doc_end = static_cast<int32_t>(
+                    static_cast<int64_t>(data_block.Size()) * (part + 1) / num_parts);
+                xorshift_rng& rng = *rngs[part];
+                std::vector<std::pair<uint64_t, int32_t>>& part_counts =
+                    counts[part];
+                std::vector<std::pair<uint64_t, int32_t>> merged;
+                std::vector<uint64_t> keys;
+                // sorts the buffered keys and merges them into part_counts
+                auto merge_keys = [&]()
+                {
+                    std::sort(keys.begin(), keys.end());
+                    merged.clear();
+                    size_t c = 0;
+                    for (size_t j = 0; j < keys.size();)
                     {
-                        Document* doc = data_block.GetOneDoc(i);
-                        int32_t& cursor = doc->Cursor();
-                        if (slice == 0) cursor = 0;
-                        int32_t last_word = meta.local_vocab(block).LastWord(slice);
-                        for (; cursor < doc->Size(); ++cursor)
+                        size_t k = j + 1;
+                        while (k < keys.size() && keys[k] == keys[j]) ++k;
+                        while (c < part_counts.size() &&
+                            part_counts[c].first < keys[j])
+                        {
+                            merged.push_back(part_counts[c++]);
+                        }
+                        int32_t count = static_cast<int32_t>(k - j);
+                        if (c < part_counts.size() &&
+                            part_counts[c].first == keys[j])
                         {
-                            if (doc->Word(cursor) > last_word) break;
-                            // Init the latent variable
-                            if (!Config::warm_start)
-                                doc->SetTopic(cursor, rng.rand_k(Config::num_topics));
-                            // Init the server table
-                            Multiverso::AddToServer<int32_t>(kWordTopicTable,
-                                doc->Word(cursor), doc->Topic(cursor), 1);
-                            Multiverso::AddToServer<int64_t>(kSummaryRow,
-                                0, doc->Topic(cursor), 1);
+                            count += part_counts[c++].second;
+                        }
+                        merged.emplace_back(keys[j], count);
+                        j = k;
+                    }
+                    merged.insert(merged.end(), part_counts.begin() + c,
+                        part_counts.end());
+                    part_counts.swap(merged);
+                    keys.clear();
+                };
+                for (int32_t i = doc_begin; i < doc_end; ++i)
+                {
+                    Document doc = data_block.GetOneDoc(i);
+                    int32_t& cursor = doc.Cursor();
+                    if (slice == 0) cursor = 0;
+                    for (; cursor < doc.Size(); ++cursor)
+                    {
+                        if (doc.Word(cursor) > last_word) break;
+                        // Init the latent variable
+                        if (random_topic)
+                            doc.SetTopic(cursor, rng.rand_k(Config::num_topics));
+                        keys.push_back(
+                            static_cast<uint64_t>(doc.Word(cursor)) << 32 |
+                            static_cast<uint32_t>(doc.Topic(cursor)));
+                        // merging once the buffer reaches the counts keeps
+                        // the cost of merges linear in the tokens
+                        if (keys.size() >= std::max(kInitKeys, part_counts.size()))
+                        {
+                            merge_keys();
                         }
                     }
-                    Multiverso::Flush();
                 }
+                merge_keys();
+            };
+            std::vector<std::thread> threads;
+            for (int32_t part = 1; part < num_parts; ++part)
+            {
+                threads.emplace_back(count_part, part);
+            }
+            count_part(0);
+            for (auto& thread : threads) thread.join();
+
+            // Init the server table, merging the counts of all parts
+            std::vector<size_t> pos(num_parts, 0);
+            while (true)
+            {
+                uint64_t key = UINT64_MAX;
+                for (int32_t part = 0; part < num_parts; ++part)
+                {
+                    if (pos[part] < counts[part].size())
+                        key = std::min(key, counts[part][pos[part]].first);
+                }
+                if (key == UINT64_MAX) break;
+                int32_t count = 0;
+                for (int32_t part = 0; part < num_parts; ++part)
+                {
+                    if (pos[part] < counts[part].size() &&
+                        counts[part][pos[part]].first == key)
+                    {
+                        count += counts[part][pos[part]++].second;
+                    }
+                }
+                int32_t word = static_cast<int32_t>(key >> 32);
+                int32_t topic = static_cast<int32_t>(key & 0xFFFFFFFF);
+                Multiverso::AddToServer<int32_t>(kWordTopicTable,
+                    word, topic, count);
+                summary[topic] += count;
+            }
+            Multiverso::Flush();
+        }
+
+        /*!
+         * \brief Restores topics of all blocks from Config::resume_dir, with
+         *  a .rank.<rank> suffix if there are several processes, and
+         *  training continues after the iteration of the checkpoint
+         * \return true if the model is restored too. Otherwise the model
+         *  should be rebuilt from the restored topics
+         */
+        static bool Resume()
+        {
+            std::string dir = Checkpoint::ResumeDirectory();
+            CheckpointManifest manifest;
+            Checkpoint::ReadManifest(dir, manifest);
+            if (!manifest.has_doc_topic)
+            {
+                Log::Fatal("Checkpoint %s has no doc topics, write it with "
+                    "-checkpoint_doc_topic to resume\n", dir.c_str());
+            }
+            if (manifest.num_vocabs != Config::num_vocabs ||
+                manifest.num_topics != Config::num_topics ||
+                manifest.num_blocks != Config::num_blocks)
+            {
+                Log::Fatal("Checkpoint %s mismatches -num_vocabs, -num_topics "
+                    "or -num_blocks\n", dir.c_str());
+            }
+            for (int32_t block = 0; block < Config::num_blocks; ++block)
+            {
+                data_stream->BeforeDataAccess();
+                Checkpoint::ReadDocTopics(dir, manifest, block,
+                    data_stream->CurrDataBlock());
                 data_stream->EndDataAccess();
             }
+            start_iteration = manifest.iteration + 1;
+            Log::Info("Resuming from iteration %d of checkpoint %s\n",
+                start_iteration, dir.c_str());
+            // rows hold counts of all processes, but only for words of the
+            // blocks of one process
+            if (Multiverso::TotalProcessCount() > 1) return false;
+
+            // shards are read on one thread each, then pushed to servers
+            // one after another
+            std::vector<std::vector<int32_t>> shards;
+            Checkpoint::ReadWordTopicShards(dir, manifest, shards);
+            for (auto& shard : shards)
+            {
+                Checkpoint::VisitShard(shard,
+                    [](int32_t word, const int32_t* pairs, int32_t size)
+                {
+                    for (int32_t i = 0; i < size; ++i)
+                    {
+                        Multiverso::AddToServer<int32_t>(kWordTopicTable,
+                            word, pairs[2 * i], pairs[2 * i + 1]);
+                    }
+                });
+                std::vector<int32_t>().swap(shard);
+            }
+            std::vector<int64_t> summary;
+            Checkpoint::ReadSummary(dir, manifest, summary);
+            for (int32_t topic = 0; topic < Config::num_topics; ++topic)
+            {
+                if (summary[topic] != 0)
+                {
+                    Multiverso::AddToServer<int64_t>(kSummaryRow,
+                        0, topic, summary[topic]);
+                }
+            }
+            Multiverso::Flush();
+            return true;
         }
 
         static void DumpDocTopic()
@@ -147,9 +363,9 @@ namespace multiverso { namespace lightlda
                 DataBlock& data_block = data_stream->CurrDataBlock();
                 for (int i = 0; i < data_block.Size(); ++i)
                 {
-                    Document* doc = data_block.GetOneDoc(i);
+                    Document doc = data_block.GetOneDoc(i);
                     doc_topic_counter.Clear();
-                    doc->GetDocTopicVector(doc_topic_counter);
+                    doc.GetDocTopicVector(doc_topic_counter);
                     fout << i << " ";  // doc id
                     Row<int32_t>::iterator iter = doc_topic_counter.Iterator();
                     while (iter.HasNext())
@@ -222,9 +438,12 @@ namespace multiverso { namespace lightlda
         static IDataStream* data_stream;
         /*! \brief training data meta information */
         static Meta meta;
+        /*! \brief first iteration to train, after a resumed checkpoint */
+        static int32_t start_iteration;
     };
     IDataStream* LightLDA::data_stream = nullptr;
     Meta LightLDA::meta;
+    int32_t LightLDA::start_iteration = 0;
 
 } // namespace lightlda
 } // namespace multiverso
@@ -1,9 +1,23 @@
 #include "meta.h"
+#include "alias_table.h"
 #include "common.h"
 
+#include <algorithm>
 #include <fstream>
 #include <multiverso/log.h>
 
+namespace
+{
+    /*!
+     * \brief weights of the slice cost model, in units of one
+     *  Metropolis-Hastings step of a token
+     */
+    const double kAliasByteCost = 0.02;
+    const double kFetchByteCost = 0.01;
+    /*! \brief barriers, alias table setup and requests of each slice */
+    const double kSliceOverhead = 1e5;
+}
+
 namespace multiverso { namespace lightlda
 {
     LocalVocab::LocalVocab() 
@@ -17,6 +31,7 @@ namespace multiverso { namespace lightlda
         vocabs_ = nullptr; 
         size_ = 0;
         slice_index_.clear();
+        slice_cost_.clear();
     }
 
 
@@ -30,23 +45,30 @@ namespace multiverso { namespace lightlda
 
     AliasTableIndex::AliasTableIndex()
     {
-        index_map_.resize(Config::num_vocabs, -1);
     }
 
     WordEntry& AliasTableIndex::word_entry(int32_t word)
     {
-        if (index_map_[word] == -1)
+        int32_t position = Find(word);
+        if (position == -1)
         {
             Log::Fatal("Fatal in alias index: word %d not exist\n", word);
         }
-        return index_[index_map_[word]];
+        return index_[position];
     }
 
     void AliasTableIndex::PushWord(int32_t word,
         bool is_dense, int64_t begin_offset, int32_t capacity)
     {
-        index_map_[word] = static_cast<int>(index_.size());
-        index_.push_back({ is_dense, begin_offset, capacity });
+        words_.push_back(word);
+        index_.push_back({ begin_offset, capacity, is_dense });
+    }
+
+    int32_t AliasTableIndex::Find(int32_t word) const
+    {
+        auto iter = std::lower_bound(words_.begin(), words_.end(), word);
+        if (iter == words_.end() || *iter != word) return -1;
+        return static_cast<int32_t>(iter - words_.begin());
     }
 
     Meta::Meta()
@@ -69,12 +91,12 @@ namespace multiverso { namespace lightlda
 
     void Meta::Init()
     {
-/*
         tf_.resize(Config::num_vocabs, 0);
         local_tf_.resize(Config::num_vocabs, 0);
         int32_t* tf = new int32_t[Config::num_vocabs];
         int32_t* local_tf = new int32_t[Config::num_vocabs];
 		local_vocabs_.resize(Config::num_blocks);
+        block_tf_.resize(Config::num_blocks);
         for (int32_t i = 0; i < Config::num_blocks; ++i)
         {
             LocalVocab& local_vocab = local_vocabs_[i];
@@ -90,9 +112,10 @@ namespace multiverso { namespace lightlda
 
             vocab_file.read(reinterpret_cast<char*>(&local_vocab.size_),
                 sizeof(int));
-            local_vocab.vocabs_ = new int[local_vocab.size_];
+            int32_t* vocabs = new int32_t[local_vocab.size_];
+            local_vocab.vocabs_ = vocabs;
             local_vocab.own_memory_ = true;
-            vocab_file.read(reinterpret_cast<char*>(local_vocab.vocabs_), 
+            vocab_file.read(reinterpret_cast<char*>(vocabs), 
                 sizeof(int)*  local_vocab.size_);
             vocab_file.read(reinterpret_cast<char*>(tf), 
                 sizeof(int)*  local_vocab.size_);
@@ -100,6 +123,7 @@ namespace multiverso { namespace lightlda
                 sizeof(int)*  local_vocab.size_);
 
             vocab_file.close();
+            block_tf_[i].assign(local_tf, local_tf + local_vocab.size_);
 
             for (int32_t i = 0; i < local_vocab.size_; ++i)
             {
@@ -126,7 +150,6 @@ namespace multiverso { namespace lightlda
             ModelSchedule4Inference();
         }
         BuildAliasIndex();
-*/
     }
 
     void Meta::Clear()
@@ -159,6 +182,8 @@ namespace multiverso { namespace lightlda
        	local_vocab.own_memory_ = false;
 		const int32_t *tf = dmp -> get_global_tf_buf();
 		const int32_t *local_tf = dmp -> get_local_tf_buf();
+        block_tf_.resize(Config::num_blocks);
+        block_tf_[i].assign(local_tf, local_tf + local_vocab.size_);
 
         for (int32_t i = 0; i < local_vocab.size_; ++i)
         {
@@ -185,69 +210,130 @@ namespace multiverso { namespace lightlda
 
     void Meta::ModelSchedule()
     {
-        int64_t model_capacity = Config::model_capacity;
-        int64_t alias_capacity = Config::alias_capacity;
-        int64_t delta_capacity = Config::delta_capacity;
-
         int32_t model_thresh = Config::num_topics / (2 * kLoadFactor);
-        int32_t alias_thresh = (Config::num_topics * 2) / 3;
         int32_t delta_thresh = Config::num_topics / (4 * kLoadFactor);
 
-
 		// Schedule for each data block
         for (int32_t i = 0; i < Config::num_blocks; ++i)
 		{
 			LocalVocab& local_vocab = local_vocabs_[i];
             const int32_t* vocabs = local_vocab.vocabs_;
-			local_vocab.slice_index_.push_back(0);
-
-            int64_t model_offset = 0;
-            int64_t alias_offset = 0;
-            int64_t delta_offset = 0;
+            std::vector<SliceCost> costs(local_vocab.size_);
+            double total_time = 0.0;
             for (int32_t j = 0; j < local_vocab.size_; ++j)
 			{
                 int32_t word = vocabs[j];
                 int32_t tf = tf_[word];
                 int32_t local_tf = local_tf_[word];
-                int32_t model_size = (tf > model_thresh) ?
+                SliceCost& cost = costs[j];
+                cost.model = (tf > model_thresh) ?
                     Config::num_topics* sizeof(int32_t) :
                     tf * kLoadFactor * sizeof(int32_t);
-                model_offset += model_size;
 
-                int32_t alias_size = (tf > alias_thresh) ?
-                    Config::num_topics * 2 * sizeof(int32_t) :
-                    tf * 3 * sizeof(int32_t);
-                alias_offset += alias_size;
+                cost.alias = AliasTable::IsDenseRow(tf) ?
+                    AliasTable::RowSize(true, Config::num_topics) :
+                    AliasTable::RowSize(false, tf);
+                cost.alias *= sizeof(int32_t);
 
-                int32_t delta_size = (local_tf > delta_thresh) ?
+                cost.delta = (local_tf > delta_thresh) ?
                     Config::num_topics * sizeof(int32_t) :
                     local_tf * kLoadFactor * 2 * sizeof(int32_t);
-                delta_offset += delta_size;
 
-                if (model_offset > model_capacity ||
-                    alias_offset > alias_capacity ||
-                    delta_offset > delta_capacity)
+                // tokens of the word in this block, building its alias row
+                // and fetching its model row
+                cost.time = static_cast<double>(block_tf_[i][j]) *
+                    Config::mh_steps +
+                    kAliasByteCost * cost.alias + kFetchByteCost * cost.model;
+                total_time += cost.time;
+			}
+
+            // the fewest slices within the capacities, then the smallest
+            // bound of slice cost that keeps that number of slices
+            int32_t num_slices = Partition(costs, 0.0, nullptr);
+            double lower = total_time / num_slices;
+            double upper = total_time;
+            for (const SliceCost& cost : costs)
+            {
+                lower = std::max(lower, cost.time);
+            }
+            while (num_slices > 1 && upper - lower > 1e-3 * upper)
+            {
+                double middle = (lower + upper) / 2;
+                if (Partition(costs, middle, nullptr) <= num_slices)
                 {
-                    Log::Info("Actual Model capacity: %d MB, Alias capacity: %d MB, Delta capacity: %dMB\n",
-                        model_offset/1024/1024, alias_offset/1024/1024, delta_offset/1024/1024);
-                    local_vocab.slice_index_.push_back(j);
-                    ++local_vocab.num_slices_;
-                    model_offset = model_size;
-                    alias_offset = alias_size;
-                    delta_offset = delta_size;
+                    upper = middle;
                 }
-			}
-            local_vocab.slice_index_.push_back(local_vocab.size_);
-            ++local_vocab.num_slices_;
-            Log::Info("INFO: block = %d, the number of slice = %d\n",
-                i, local_vocab.num_slices_);
+                else
+                {
+                    lower = middle;
+                }
+            }
+            Partition(costs, num_slices > 1 ? upper : 0.0,
+                &local_vocab.slice_index_);
+            local_vocab.num_slices_ =
+                static_cast<int32_t>(local_vocab.slice_index_.size()) - 1;
+
+            local_vocab.slice_cost_.assign(local_vocab.num_slices_,
+                kSliceOverhead);
+            double max_cost = 0.0, min_cost = total_time + kSliceOverhead;
+            for (int32_t slice = 0; slice < local_vocab.num_slices_; ++slice)
+            {
+                double& slice_cost = local_vocab.slice_cost_[slice];
+                for (int32_t j = local_vocab.slice_index_[slice];
+                    j < local_vocab.slice_index_[slice + 1]; ++j)
+                {
+                    slice_cost += costs[j].time;
+                }
+                max_cost = std::max(max_cost, slice_cost);
+                min_cost = std::min(min_cost, slice_cost);
+            }
+            Log::Info("INFO: block = %d, the number of slice = %d, "
+                "predicted slice cost = [%.0f, %.0f]\n",
+                i, local_vocab.num_slices_, min_cost, max_cost);
 		}
     }
 
+    int32_t Meta::Partition(const std::vector<SliceCost>& costs,
+        double max_time, std::vector<int32_t>* slice_index)
+    {
+        if (slice_index != nullptr)
+        {
+            slice_index->clear();
+            slice_index->push_back(0);
+        }
+        int32_t num_slices = 1;
+        int32_t slice_begin = 0;
+        SliceCost sum = { 0, 0, 0, 0.0 };
+        for (int32_t j = 0; j < static_cast<int32_t>(costs.size()); ++j)
+        {
+            const SliceCost& cost = costs[j];
+            // a slice always takes its first word, even if it is too large
+            if (j > slice_begin &&
+                (sum.model + cost.model > Config::model_capacity ||
+                sum.alias + cost.alias > Config::alias_capacity ||
+                sum.delta + cost.delta > Config::delta_capacity ||
+                (max_time > 0.0 && sum.time + cost.time > max_time)))
+            {
+                if (slice_index != nullptr) slice_index->push_back(j);
+                ++num_slices;
+                slice_begin = j;
+                sum = { 0, 0, 0, 0.0 };
+            }
+            sum.model += cost.model;
+            sum.alias += cost.alias;
+            sum.delta += cost.delta;
+            sum.time += cost.time;
+        }
+        if (slice_index != nullptr)
+        {
+            slice_index->push_back(static_cast<int32_t>(costs.size()));
+        }
+        return num_slices;
+    }
+
     void Meta::ModelSchedule4Inference()
     {
         Config::alias_capacity = 0;
-        int32_t alias_thresh = (Config::num_topics * 2) / 3;
         // Schedule for each data block
         for (int32_t i = 0; i < Config::num_blocks; ++i)
         {
@@ -261,9 +347,10 @@ namespace multiverso { namespace lightlda
             {
                 int32_t word = vocabs[j];
                 int32_t tf = tf_[word];
-                int32_t alias_size = (tf > alias_thresh) ?
-                    Config::num_topics * 2 * sizeof(int32_t) :
-                    tf * 3 * sizeof(int32_t);
+                int64_t alias_size = AliasTable::IsDenseRow(tf) ?
+                    AliasTable::RowSize(true, Config::num_topics) :
+                    AliasTable::RowSize(false, tf);
+                alias_size *= sizeof(int32_t);
                 alias_offset += alias_size;
             }
             if(alias_offset > Config::alias_capacity)
@@ -276,7 +363,6 @@ namespace multiverso { namespace lightlda
 
     void Meta::BuildAliasIndex()
     {
-        int32_t alias_thresh = (Config::num_topics * 2) / 3;
         alias_index_.resize(Config::num_blocks);
         // for each block
         for (int32_t i = 0; i < Config::num_blocks; ++i)
@@ -292,15 +378,9 @@ namespace multiverso { namespace lightlda
                     p != vocab.end(j); ++p)
                 {
                     int32_t word = *p;
-                    bool is_dense = true;
-                    int32_t capacity = Config::num_topics;
-                    int64_t size = Config::num_topics * 2;
-                    if (tf(word) <= alias_thresh)
-                    {
-                        is_dense = false;
-                        capacity = tf(word);
-                        size = tf(word) * 3;
-                    }
+                    bool is_dense = AliasTable::IsDenseRow(tf(word));
+                    int32_t capacity = is_dense ? Config::num_topics : tf(word);
+                    int64_t size = AliasTable::RowSize(is_dense, capacity);
                     alias_index_[i][j]->PushWord(word, is_dense, offset, capacity);
                     offset += size;
                 }
@@ -31,6 +31,11 @@ namespace multiverso { namespace lightlda
         const int* begin(int32_t slice) const;
         /*! \brief Get the pointer to last word + 1 in this slice */
         const int32_t* end(int32_t slice) const;
+        /*!
+         * \brief Get the predicted cost of training this slice, in units of
+         *  one Metropolis-Hastings step of a token
+         */
+        double slice_cost(int32_t slice) const;
         /*! \brief clear the LocalVocab */
         void Clear();
     private:
@@ -39,26 +44,53 @@ namespace multiverso { namespace lightlda
         int32_t size_;
         bool own_memory_;
         std::vector<int32_t> slice_index_;
+        std::vector<double> slice_cost_;
     };
 
 
+    /*! \brief Alias row of a word, ordered to pack into 16 bytes */
     struct WordEntry
     {
-        bool is_dense;
         int64_t begin_offset;
         int32_t capacity;
+        bool is_dense;
     };
 
+    /*!
+     * \brief AliasTableIndex locates the alias rows of the words of a slice.
+     *  Words are kept sorted as in LocalVocab, so the index costs memory
+     *  of the slice only. AliasTable maps words to positions while the
+     *  slice is trained, other lookups use binary search
+     */
     class AliasTableIndex
     {
     public:
         AliasTableIndex();
+        /*! \brief Get the alias row of word, Fatal if word not exists */
         WordEntry& word_entry(int32_t word);
+        /*! \brief Pushes a word, larger than the words pushed before */
         void PushWord(int32_t word, bool is_dense,
             int64_t begin_offset, int32_t capacity);
+        /*! \brief Get the position of word, -1 if not exists */
+        int32_t Find(int32_t word) const;
+        /*! \brief Get the number of words */
+        int32_t size() const;
+        /*! \brief Get the word at position */
+        int32_t word(int32_t position) const;
+        /*! \brief Get the alias row of the word at position */
+        WordEntry& entry(int32_t position);
     private:
         std::vector<WordEntry> index_;
-        std::vector<int32_t> index_map_;
+        std::vector<int32_t> words_;
+    };
+
+    /*! \brief Memory and predicted time of training some words */
+    struct SliceCost
+    {
+        int64_t model;
+        int64_t alias;
+        int64_t delta;
+        double time;
     };
 
     /*!
@@ -84,8 +116,19 @@ namespace multiverso { namespace lightlda
         AliasTableIndex* alias_index(int32_t block, int32_t slice);
         void Clear();
     private:
-        /*! \brief Schedule the model and split as slices based on memory */
+        /*!
+         * \brief Schedule the model and split as slices. Slices are as few
+         *  as the memory capacities allow, and balanced by predicted cost
+         */
         void ModelSchedule();
+        /*!
+         * \brief Greedily splits words into slices within the capacities,
+         *  and within max_time of predicted cost if max_time > 0
+         * \param slice_index receives the slice boundaries if not null
+         * \return number of slices
+         */
+        static int32_t Partition(const std::vector<SliceCost>& costs,
+            double max_time, std::vector<int32_t>* slice_index);
         /*! \brief Schedule the model without vocabulary sliptting */
         void ModelSchedule4Inference();
         /*! \brief Build index for alias table */
@@ -97,6 +140,8 @@ namespace multiverso { namespace lightlda
         std::vector<int32_t> tf_;
         /*! \brief local tf information for all word in this machine */
         std::vector<int32_t> local_tf_;
+        /*! \brief tf of each word of local vocab in its block */
+        std::vector<std::vector<int32_t>> block_tf_;
 
         std::vector<std::vector<AliasTableIndex*> > alias_index_;
         // No copying allowed
@@ -118,12 +163,28 @@ namespace multiverso { namespace lightlda
     {
         return vocabs_ + slice_index_[slice + 1];
     }
+    inline double LocalVocab::slice_cost(int32_t slice) const
+    {
+        return slice_cost_[slice];
+    }
     inline int32_t Meta::tf(int32_t word) const { return tf_[word]; }
     inline int32_t Meta::local_tf(int32_t word) const { return local_tf_[word]; }
     inline const LocalVocab& Meta::local_vocab(int32_t id) const
     {
         return local_vocabs_[id]; 
     }
+    inline int32_t AliasTableIndex::size() const
+    {
+        return static_cast<int32_t>(words_.size());
+    }
+    inline int32_t AliasTableIndex::word(int32_t position) const
+    {
+        return words_[position];
+    }
+    inline WordEntry& AliasTableIndex::entry(int32_t position)
+    {
+        return index_[position];
+    }
     inline AliasTableIndex* Meta::alias_index(int32_t block, int32_t slice)
     {
         return alias_index_[block][slice];
@@ -0,0 +1,145 @@
+#include "metrics.h"
+#include "common.h"
+
+#include <multiverso/log.h>
+
+#include <algorithm>
+
+namespace
+{
+    double Ratio(int64_t numerator, int64_t denominator)
+    {
+        return denominator == 0 ? 0.0
+            : static_cast<double>(numerator) / denominator;
+    }
+}
+
+namespace multiverso { namespace lightlda
+{
+    FILE* Metrics::file_ = nullptr;
+    int32_t Metrics::rank_ = 0;
+    std::mutex Metrics::mutex_;
+    std::vector<ThreadStats> Metrics::thread_stats_;
+    int32_t Metrics::num_committed_ = 0;
+    double Metrics::likelihood_[3] = { 0.0, 0.0, 0.0 };
+    bool Metrics::has_likelihood_[3] = { false, false, false };
+    double Metrics::io_stall_seconds_ = 0.0;
+
+    void Metrics::Init(int32_t rank)
+    {
+        rank_ = rank;
+        if (Config::metrics_file.empty()) return;
+        // one file per process, rank 0 uses the given name
+        std::string file_name = Config::metrics_file;
+        if (rank != 0) file_name += "." + std::to_string(rank);
+        file_ = fopen(file_name.c_str(), "w");
+        if (file_ == nullptr)
+        {
+            Log::Fatal("Failed to open metrics file %s\n", file_name.c_str());
+        }
+    }
+
+    void Metrics::Close()
+    {
+        if (file_ != nullptr)
+        {
+            fclose(file_);
+            file_ = nullptr;
+        }
+    }
+
+    bool Metrics::Enabled() { return file_ != nullptr; }
+
+    void Metrics::RecordLikelihood(Likelihood type, double value)
+    {
+        if (!Enabled()) return;
+        std::lock_guard<std::mutex> lock(mutex_);
+        likelihood_[static_cast<int32_t>(type)] = value;
+        has_likelihood_[static_cast<int32_t>(type)] = true;
+    }
+
+    void Metrics::RecordIOStall(double seconds)
+    {
+        if (!Enabled()) return;
+        std::lock_guard<std::mutex> lock(mutex_);
+        io_stall_seconds_ += seconds;
+    }
+
+    void Metrics::Commit(int32_t iteration, int32_t block, int32_t slice,
+        int32_t thread_id, int32_t num_threads, const ThreadStats& stats)
+    {
+        if (!Enabled()) return;
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (static_cast<int32_t>(thread_stats_.size()) != num_threads)
+        {
+            thread_stats_.resize(num_threads);
+        }
+        thread_stats_[thread_id] = stats;
+        if (++num_committed_ < num_threads) return;
+
+        WriteRecord(iteration, block, slice);
+        num_committed_ = 0;
+        io_stall_seconds_ = 0.0;
+        for (int32_t i = 0; i < 3; ++i) has_likelihood_[i] = false;
+    }
+
+    void Metrics::WriteRecord(int32_t iteration, int32_t block, int32_t slice)
+    {
+        ThreadStats total = ThreadStats();
+        // threads leave the slice together, so the slowest one is the
+        // wall time of the slice, without evaluation
+        double train_seconds = 0.0;
+        for (auto& stats : thread_stats_)
+        {
+            train_seconds = std::max(train_seconds, stats.alias_seconds
+                + stats.sampling_seconds + stats.barrier_seconds);
+            total.num_tokens += stats.num_tokens;
+            total.word_proposals += stats.word_proposals;
+            total.word_accepts += stats.word_accepts;
+            total.doc_proposals += stats.doc_proposals;
+            total.doc_accepts += stats.doc_accepts;
+            total.topic_changes += stats.topic_changes;
+        }
+        fprintf(file_, "{\"rank\":%d,\"iteration\":%d,\"block\":%d,"
+            "\"slice\":%d,\"tokens\":%lld,\"train_seconds\":%.6f,"
+            "\"io_stall_seconds\":%.6f,\"word_accept_rate\":%.6f,"
+            "\"doc_accept_rate\":%.6f,\"topic_change_rate\":%.6f",
+            rank_, iteration, block, slice,
+            static_cast<long long>(total.num_tokens), train_seconds,
+            io_stall_seconds_,
+            Ratio(total.word_accepts, total.word_proposals),
+            Ratio(total.doc_accepts, total.doc_proposals),
+            Ratio(total.topic_changes, total.num_tokens));
+
+        const char* llh_names[3] = { "doc_llh", "word_llh", "normalized_llh" };
+        for (int32_t i = 0; i < 3; ++i)
+        {
+            if (has_likelihood_[i])
+                fprintf(file_, ",\"%s\":%.6e", llh_names[i], likelihood_[i]);
+            else
+                fprintf(file_, ",\"%s\":null", llh_names[i]);
+        }
+
+        fprintf(file_, ",\"threads\":[");
+        for (size_t i = 0; i < thread_stats_.size(); ++i)
+        {
+            const ThreadStats& stats = thread_stats_[i];
+            double seconds = stats.sampling_seconds;
+            fprintf(file_, "%s{\"id\":%d,\"tokens\":%lld,"
+                "\"alias_seconds\":%.6f,\"sampling_seconds\":%.6f,"
+                "\"barrier_seconds\":%.6f,\"tokens_per_sec\":%.1f,"
+                "\"word_accept_rate\":%.6f,\"doc_accept_rate\":%.6f,"
+                "\"topic_change_rate\":%.6f}",
+                i == 0 ? "" : ",", static_cast<int32_t>(i), static_cast<long long>(stats.num_tokens),
+                stats.alias_seconds, stats.sampling_seconds,
+                stats.barrier_seconds,
+                seconds > 0 ? stats.num_tokens / seconds : 0.0,
+                Ratio(stats.word_accepts, stats.word_proposals),
+                Ratio(stats.doc_accepts, stats.doc_proposals),
+                Ratio(stats.topic_changes, stats.num_tokens));
+        }
+        fprintf(file_, "]}\n");
+        fflush(file_);
+    }
+} // namespace lightlda
+} // namespace multiverso
@@ -9,14 +9,32 @@
 
 #include <algorithm>
 #include <fstream>
+#include <mutex>
 #include <sstream>
 
+#include "checkpoint.h"
 #include "meta.h"
+#include "row_cache.h"
+#include "text_parser.h"
 #include "trainer.h"
 
 #include <multiverso/log.h>
 #include <multiverso/multiverso.h>
 
+namespace
+{
+    /*! \brief Parses a topic:freq feature of a model line, advancing ptr */
+    bool ParseFeature(const char*& ptr, const char* end,
+        int32_t& topic_id, int32_t& freq)
+    {
+        using multiverso::lightlda::TextParser;
+        return TextParser::ParseInt(ptr, end, topic_id) &&
+            ptr != end && *ptr++ == ':' &&
+            TextParser::ParseInt(ptr, end, freq) &&
+            (ptr == end || *ptr == ' ' || *ptr == '\t');
+    }
+}
+
 namespace multiverso { namespace lightlda
 {
     LocalModel::LocalModel(Meta * meta) : word_topic_table_(nullptr),
@@ -63,6 +81,11 @@ namespace multiverso { namespace lightlda
 
     void LocalModel::LoadTable()
     {
+        if (Checkpoint::Exists(Config::input_dir))
+        {
+            LoadCheckpoint(Config::input_dir);
+            return;
+        }
 #ifdef _MSC_VER
         Log::Fatal("Not implementent yet on Windows\n");
 #else
@@ -113,23 +136,11 @@ namespace multiverso { namespace lightlda
         meta_ = meta;
         //LoadWordTopicTable(Config::input_dir + "/" + "server_0_table_0.model");
 
-		multiverso::Format dense_format = multiverso::Format::Dense;
-        multiverso::Format sparse_format = multiverso::Format::Sparse;
-
 		std::vector<int32_t> word_list = dmp -> get_local_words();
 		for(auto word_id : word_list)
 		{
             //set row
-            if (meta_->tf(word_id) * kLoadFactor > Config::num_topics)
-            {
-                word_topic_table_->SetRow(word_id, dense_format, 
-                    Config::num_topics);
-            }
-            else
-            {
-                word_topic_table_->SetRow(word_id, sparse_format, 
-                    meta_->tf(word_id) * kLoadFactor);
-            }
+            InitWordTopicRow(word_id, meta_->tf(word_id));
             //get row
             Row<int32_t> * row = static_cast<Row<int32_t>*>
                 (word_topic_table_->GetRow(word_id));
@@ -157,51 +168,35 @@ namespace multiverso { namespace lightlda
 
     void LocalModel::LoadWordTopicTable(const std::string& model_fname)
     {
-        multiverso::Format dense_format = multiverso::Format::Dense;
-        multiverso::Format sparse_format = multiverso::Format::Sparse;
         std::ifstream model_file(model_fname, std::ios::in);
         std::string line;
         while (getline(model_file, line))
         {
-            std::stringstream ss(line);
-            std::string word;
-            std::string fea;
-            std::vector<std::string> feas;
+            const char* end = TextParser::TrimRight(TextView(line)).end;
+            const char* ptr = TextParser::SkipSpaces(line.data(), end);
             int32_t word_id, topic_id, freq;
             //assign word id
-            ss >> word;
-            word_id = std::stoi(word);
+            if (ptr == end) continue;
+            if (!TextParser::ParseInt(ptr, end, word_id))
+            {
+                Log::Fatal("bad format of model: %s\n", line.c_str());
+            }
             if (meta_->tf(word_id) > 0)
             {
                 //set row
-                if (meta_->tf(word_id) * kLoadFactor > Config::num_topics)
-                {
-                    word_topic_table_->SetRow(word_id, dense_format, 
-                        Config::num_topics);
-                }
-                else
-                {
-                    word_topic_table_->SetRow(word_id, sparse_format, 
-                        meta_->tf(word_id) * kLoadFactor);
-                }
+                InitWordTopicRow(word_id, meta_->tf(word_id));
                 //get row
                 Row<int32_t> * row = static_cast<Row<int32_t>*>
                     (word_topic_table_->GetRow(word_id));
 
                 //add features to row
-                while (ss >> fea)
+                while ((ptr = TextParser::SkipSpaces(ptr, end)) != end)
                 {
-                    size_t pos = fea.find_last_of(':');
-                    if (pos != std::string::npos)
-                    {
-                        topic_id = std::stoi(fea.substr(0, pos));
-                        freq = std::stoi(fea.substr(pos + 1));
-                        row->Add(topic_id, freq);
-                    }
-                    else
+                    if (!ParseFeature(ptr, end, topic_id, freq))
                     {
                         Log::Fatal("bad format of model: %s\n", line.c_str());
                     }
+                    row->Add(topic_id, freq);
                 }
             }
         }
@@ -216,20 +211,16 @@ namespace multiverso { namespace lightlda
         std::string line;
         if (getline(model_file, line))
         {
-            std::stringstream ss(line);
-            std::string fea;
-            std::vector<std::string> feas;
+            const char* end = TextParser::TrimRight(TextView(line)).end;
             int32_t topic_id, freq;
             //skip word id
-            ss >> fea;
+            const char* ptr = TextParser::SkipSpaces(line.data(), end);
+            while (ptr < end && *ptr != ' ' && *ptr != '\t') ++ptr;
             //add features to row
-            while (ss >> fea)
+            while ((ptr = TextParser::SkipSpaces(ptr, end)) != end)
             {
-                size_t pos = fea.find_last_of(':');
-                if (pos != std::string::npos)
+                if (ParseFeature(ptr, end, topic_id, freq))
                 {
-                    topic_id = std::stoi(fea.substr(0, pos));
-                    freq = std::stoi(fea.substr(pos + 1));
                     row->Add(topic_id, freq);
                 }
                 else
@@ -241,15 +232,67 @@ namespace multiverso { namespace lightlda
         model_file.close();
     }
 
+    void LocalModel::LoadCheckpoint(const std::string& dir)
+    {
+        Log::Info("loading checkpoint %s\n", dir.c_str());
+        CheckpointManifest manifest;
+        Checkpoint::ReadManifest(dir, manifest);
+        if (manifest.num_topics != Config::num_topics)
+        {
+            Log::Fatal("checkpoint %s has %d topics\n", dir.c_str(),
+                manifest.num_topics);
+        }
+        // rows are disjoint across shards, only creating them is serialized
+        std::mutex mutex;
+        Checkpoint::ReadWordTopic(dir, manifest,
+            [&](int32_t word, const int32_t* pairs, int32_t size)
+        {
+            if (word >= Config::num_vocabs || meta_->tf(word) <= 0) return;
+            Row<int32_t> * row;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                InitWordTopicRow(word, meta_->tf(word));
+                row = static_cast<Row<int32_t>*>(word_topic_table_->GetRow(word));
+            }
+            for (int32_t i = 0; i < size; ++i)
+            {
+                row->Add(pairs[2 * i], pairs[2 * i + 1]);
+            }
+        });
+
+        std::vector<int64_t> summary;
+        Checkpoint::ReadSummary(dir, manifest, summary);
+        Row<int64_t> * row = static_cast<Row<int64_t>*>
+            (summary_table_->GetRow(0));
+        for (int32_t topic = 0; topic < Config::num_topics; ++topic)
+        {
+            if (summary[topic] != 0) row->Add(topic, summary[topic]);
+        }
+    }
+
+    void LocalModel::InitWordTopicRow(integer_t word_id, int32_t tf)
+    {
+        if (tf * kLoadFactor > Config::num_topics)
+        {
+            word_topic_table_->SetRow(word_id, multiverso::Format::Dense,
+                Config::num_topics);
+        }
+        else
+        {
+            word_topic_table_->SetRow(word_id, multiverso::Format::Sparse,
+                tf * kLoadFactor);
+        }
+    }
+
     void LocalModel::AddWordTopicRow(
         integer_t word_id, integer_t topic_id, int32_t delta) 
     {
-        Log::Fatal("Not implemented yet\n");
+        GetWordTopicRow(word_id).Add(topic_id, delta);
     }
 
     void LocalModel::AddSummaryRow(integer_t topic_id, int64_t delta) 
     {
-        Log::Fatal("Not implemented yet\n");
+        GetSummaryRow().Add(topic_id, delta);
     }
 
     Row<int32_t>& LocalModel::GetWordTopicRow(integer_t word)
@@ -264,6 +307,7 @@ namespace multiverso { namespace lightlda
     
     Row<int32_t>& PSModel::GetWordTopicRow(integer_t word_id)
     {
+        if (RowCache::resident()) return RowCache::GetRow(word_id);
         return trainer_->GetRow<int32_t>(kWordTopicTable, word_id);
     }
 
@@ -276,6 +320,7 @@ namespace multiverso { namespace lightlda
         integer_t word_id, integer_t topic_id, int32_t delta)
     {
         trainer_->Add<int32_t>(kWordTopicTable, word_id, topic_id, delta);
+        if (RowCache::resident()) RowCache::Add(word_id, topic_id, delta);
     }
 
     void PSModel::AddSummaryRow(integer_t topic_id, int64_t delta)
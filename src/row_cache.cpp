@@ -0,0 +1,112 @@
+#include "row_cache.h"
+
+#include "common.h"
+#include "meta.h"
+
+#include <multiverso/log.h>
+#include <multiverso/row.h>
+#include <multiverso/table.h>
+
+#include <climits>
+
+namespace multiverso { namespace lightlda
+{
+    bool RowCache::resident_ = false;
+    std::vector<int32_t> RowCache::version_;
+    std::unique_ptr<Table> RowCache::table_;
+    std::mutex RowCache::locks_[RowCache::kNumLocks];
+
+    void RowCache::Init(const Meta& meta)
+    {
+        resident_ = false;
+        version_.clear();
+        table_.reset();
+        if (Config::model_refresh_interval == 1) return;
+
+        // same row sizes as Meta::ModelSchedule, over the union of blocks
+        int32_t model_thresh = Config::num_topics / (2 * kLoadFactor);
+        int64_t model_size = 0;
+        for (int32_t word = 0; word < Config::num_vocabs; ++word)
+        {
+            int32_t tf = meta.tf(word);
+            if (meta.local_tf(word) == 0) continue;
+            model_size += (tf > model_thresh) ?
+                Config::num_topics * sizeof(int32_t) :
+                tf * kLoadFactor * sizeof(int32_t);
+        }
+        if (model_size > Config::model_capacity)
+        {
+            Log::Info("Local model of %lld MB exceeds model capacity, rows "
+                "are refreshed every iteration\n",
+                static_cast<long long>(model_size / 1024 / 1024));
+            return;
+        }
+        resident_ = true;
+        version_.assign(Config::num_vocabs, INT32_MIN);
+        // rows are shaped as the cache rows set in LightLDA::ConfigTable
+        table_.reset(new Table(kWordTopicTable, Config::num_vocabs,
+            Config::num_topics, Type::Int, multiverso::Format::Dense));
+        for (int32_t word = 0; word < Config::num_vocabs; ++word)
+        {
+            int32_t tf = meta.tf(word);
+            if (meta.local_tf(word) == 0) continue;
+            if (tf * kLoadFactor > Config::num_topics)
+            {
+                table_->SetRow(word, multiverso::Format::Dense,
+                    Config::num_topics);
+            }
+            else
+            {
+                table_->SetRow(word, multiverso::Format::Sparse,
+                    tf * kLoadFactor);
+            }
+        }
+        Log::Info("Local model of %lld MB is resident, rows are refreshed "
+            "every %d iterations\n",
+            static_cast<long long>(model_size / 1024 / 1024),
+            Config::model_refresh_interval);
+    }
+
+    bool RowCache::NeedRefresh(int32_t word, int32_t iteration)
+    {
+        if (!resident_) return true;
+        int32_t interval = Config::model_refresh_interval;
+        int32_t& version = version_[word];
+        if (version == INT32_MIN)
+        {
+            // back-date the first fetch, so refreshes of different rows
+            // are spread over the iterations of an interval
+            version = interval > 0 ? iteration - word % interval : iteration;
+            return true;
+        }
+        if (interval == 0 || iteration - version < interval) return false;
+        version = iteration - (iteration - version) % interval;
+        return true;
+    }
+
+    void RowCache::Refresh(int32_t word, Row<int32_t>& fetched)
+    {
+        Row<int32_t>& row = GetRow(word);
+        std::lock_guard<std::mutex> lock(locks_[word % kNumLocks]);
+        row.Clear();
+        Row<int32_t>::iterator iter = fetched.Iterator();
+        while (iter.HasNext())
+        {
+            if (iter.Value() != 0) row.Add(iter.Key(), iter.Value());
+            iter.Next();
+        }
+    }
+
+    Row<int32_t>& RowCache::GetRow(int32_t word)
+    {
+        return *(static_cast<Row<int32_t>*>(table_->GetRow(word)));
+    }
+
+    void RowCache::Add(int32_t word, int32_t topic, int32_t delta)
+    {
+        Row<int32_t>& row = GetRow(word);
+        std::lock_guard<std::mutex> lock(locks_[word % kNumLocks]);
+        row.Add(topic, delta);
+    }
+} // namespace lightlda
+} // namespace multiverso
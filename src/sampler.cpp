@@ -17,11 +17,13 @@ namespace multiverso { namespace lightlda
         num_vocab_ = Config::num_vocabs;
         num_topic_ = Config::num_topics;
         mh_steps_ = Config::mh_steps;
+        prefetch_tokens_ = Config::prefetch_tokens;
 
         alpha_sum_ = num_topic_ * alpha_;
         beta_sum_ = num_vocab_ * beta_;
 
         subtractor_ = Config::inference ? 0 : 1;
+        stats_ = ThreadStats();
 
         doc_topic_counter_.reset(new Row<int32_t>(0, 
             multiverso::Format::Sparse, kMaxDocLength));
@@ -34,15 +36,27 @@ namespace multiverso { namespace lightlda
         int32_t num_tokens = 0;
         int32_t& cursor = doc->Cursor();
         if (slice == 0) cursor = 0;
+        Row<int64_t>& summary_row = model->GetSummaryRow();
+        // tokens are sorted by word, so the handle is looked up once per
+        // run of a repeated word
+        const WordHandle* handle = nullptr;
+        int32_t handle_word = -1;
         for (; cursor != doc->Size(); ++cursor)
         {
             int32_t word = doc->Word(cursor);
             if (word > lastword) break;
+            if (prefetch_tokens_ > 0) Prefetch(doc, cursor, lastword, alias);
+            if (word != handle_word)
+            {
+                handle = &alias->handle(word);
+                handle_word = word;
+            }
             int32_t old_topic = doc->Topic(cursor);
-            int32_t new_topic = Sample(doc, word, old_topic, old_topic,
-                model, alias);
+            int32_t new_topic = Sample(doc, *handle, summary_row,
+                old_topic, old_topic, alias);
             if (old_topic != new_topic)
             {
+                ++stats_.topic_changes;
                 doc->SetTopic(cursor, new_topic);
                 doc_topic_counter_->Add(old_topic, -1);
                 doc_topic_counter_->Add(new_topic, 1);
@@ -65,9 +79,26 @@ namespace multiverso { namespace lightlda
         doc->GetDocTopicVector(*doc_topic_counter_);
     }
 
+    void LightDocSampler::Prefetch(Document* doc, int32_t cursor,
+        int32_t lastword, AliasTable* alias)
+    {
+        int32_t size = doc->Size();
+        for (int32_t stage = 3; stage >= 1; --stage)
+        {
+            int32_t ahead = cursor + stage * prefetch_tokens_;
+            if (ahead >= size) continue;
+            int32_t word = doc->Word(ahead);
+            // a run of a word is prefetched once
+            if (word > lastword || word == doc->Word(ahead - 1)) continue;
+            if (stage == 3) alias->PrefetchPosition(word);
+            else if (stage == 2) alias->PrefetchHandle(word);
+            else alias->PrefetchAliasRow(word);
+        }
+    }
+
     int32_t LightDocSampler::Sample(Document* doc,
-        int32_t word, int32_t old_topic, int32_t s,
-        ModelBase* model, AliasTable* alias)
+        const WordHandle& handle, Row<int64_t>& summary_row,
+        int32_t old_topic, int32_t s, AliasTable* alias)
     {
         int32_t t, w_t_cnt, w_s_cnt;
         int64_t n_t, n_s;
@@ -78,13 +109,12 @@ namespace multiverso { namespace lightlda
         double rejection, pi;
         int32_t m;
 
-        Row<int32_t>& word_topic_row = model->GetWordTopicRow(word);
-        Row<int64_t>& summary_row = model->GetSummaryRow();
+        Row<int32_t>& word_topic_row = *handle.row;
 
         for (int32_t i = 0; i < mh_steps_; ++i)
         {
             // Word proposal
-            t = alias->Propose(word, rng_);
+            t = alias->Propose(handle, rng_);
             if (t < 0 || t >= num_topic_)
             {
                 Log::Fatal("Invalid topic assignment %d from word proposal\n", t);
@@ -127,6 +157,8 @@ namespace multiverso { namespace lightlda
 
                 m = -(rejection < pi);
                 s = (t & m) | (s & ~m);
+                ++stats_.word_proposals;
+                stats_.word_accepts -= m;
             }
             // Doc proposal
             double n_td_or_alpha = rng_.rand_double() *
@@ -179,27 +211,28 @@ namespace multiverso { namespace lightlda
 
                 m = -(rejection < pi);
                 s = (t & m) | (s & ~m);
+                ++stats_.doc_proposals;
+                stats_.doc_accepts -= m;
             }
         }
         return s;
     }
 
     int32_t LightDocSampler::ApproxSample(Document* doc,
-        int32_t word, int32_t old_topic, int32_t s,
-        ModelBase* model, AliasTable* alias)
+        const WordHandle& handle, Row<int64_t>& summary_row,
+        int32_t old_topic, int32_t s, AliasTable* alias)
     {
         float n_tw_beta, n_sw_beta, n_t_beta_sum, n_s_beta_sum;
         float nominator, denominator;
         double rejection, pi;
         int32_t m, t;
         
-        Row<int32_t>& word_topic_row = model->GetWordTopicRow(word);
-        Row<int64_t>& summary_row = model->GetSummaryRow();
+        Row<int32_t>& word_topic_row = *handle.row;
 
         for (int32_t i = 0; i < mh_steps_; ++i)
         {
             // word proposal
-            t = alias->Propose(word, rng_);
+            t = alias->Propose(handle, rng_);
             if (t != s)
             {
                 nominator = doc_topic_counter_->At(t) + alpha_;
@@ -216,6 +249,8 @@ namespace multiverso { namespace lightlda
                 rejection = rng_.rand_double();
                 m = -(rejection < pi);
                 s = (t & m) | (s & ~m);
+                ++stats_.word_proposals;
+                stats_.word_accepts -= m;
             }
             // doc proposal
             double n_td_or_alpha = rng_.rand_double() *
@@ -253,6 +288,8 @@ namespace multiverso { namespace lightlda
                 rejection = rng_.rand_double();
                 m = -(rejection < pi);
                 s = (t & m) | (s & ~m);
+                ++stats_.doc_proposals;
+                stats_.doc_accepts -= m;
             }
         }
         return s;
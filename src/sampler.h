@@ -7,6 +7,7 @@
 #define LIGHTLDA_SAMPLER_H_
 
 #include <memory>
+#include "metrics.h"
 #include "util.h"
 
 namespace multiverso
@@ -20,10 +21,13 @@ namespace multiverso { namespace lightlda
     class AliasTable;
     class Document;
     class ModelBase;
+    struct WordHandle;
     
     /*! \brief lightlda sampler */
     class LightDocSampler
     {
+        // microbenchmarks compare Sample with ApproxSample directly
+        friend class SamplerBenchmark;
     public:
         LightDocSampler();
         /*! 
@@ -43,23 +47,36 @@ namespace multiverso { namespace lightlda
          * \return reference to light hash map
          */
         Row<int32_t>& doc_topic_counter() { return *doc_topic_counter_; }
+        /*!
+         * \brief Get Metropolis-Hastings statistics accumulated by sampling,
+         *  the caller is responsible for resetting them
+         */
+        ThreadStats& stats() { return stats_; }
     private:
         /*!
          * \brief Init document before sampling
          * \param doc pointer to document
          */
         void DocInit(Document* doc);
+        /*!
+         * \brief Prefetches the state of tokens ahead of cursor, in stages
+         *  at 3, 2 and 1 times prefetch_tokens_ ahead, so the misses of
+         *  later tokens overlap with sampling the current one
+         */
+        void Prefetch(Document* doc, int32_t cursor, int32_t lastword,
+            AliasTable* alias);
         /*!
          * \brief Sample the latent topic assignment for a token 
          * \param doc current document
-         * \param word current token
+         * \param handle row and alias of the word of current token
+         * \param summary_row summary row of the model
          * \param state state of the word
          * \param old_topic old topic assignment of this token
-         * \param model access
          * \param alias for alias table access
          */
-        int32_t Sample(Document* doc, int32_t word, int32_t state, 
-            int32_t old_topic, ModelBase* model, AliasTable* alias);
+        int32_t Sample(Document* doc, const WordHandle& handle,
+            Row<int64_t>& summary_row, int32_t state, int32_t old_topic,
+            AliasTable* alias);
 
         /*! 
          * \brief Sample the latent topic assignment for a token. This function
@@ -68,8 +85,9 @@ namespace multiverso { namespace lightlda
          *  with faster speed.
          * \param same with Sample
          */
-        int32_t ApproxSample(Document* doc, int32_t word, int32_t state, 
-            int32_t old_topic, ModelBase* model, AliasTable* alias);
+        int32_t ApproxSample(Document* doc, const WordHandle& handle,
+            Row<int64_t>& summary_row, int32_t state, int32_t old_topic,
+            AliasTable* alias);
     private:
         // lda hyper-parameter
         float alpha_;
@@ -82,9 +100,11 @@ namespace multiverso { namespace lightlda
         int32_t num_vocab_;
         int32_t num_topic_;
         int32_t mh_steps_;
+        int32_t prefetch_tokens_;
 
         xorshift_rng rng_;
         std::unique_ptr<Row<int32_t>> doc_topic_counter_;
+        ThreadStats stats_;
     };
 } // namespace lightlda
 } // namespace multiverso
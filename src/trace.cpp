@@ -0,0 +1,115 @@
+#include "trace.h"
+#include "common.h"
+
+#include <cstdio>
+
+#include <multiverso/log.h>
+
+namespace multiverso { namespace lightlda
+{
+    namespace
+    {
+        /*! \brief number of events kept per thread, older ones are dropped */
+        const int64_t kTraceBufferSize = 1 << 16;
+    }
+
+    bool Tracer::enabled_ = false;
+    int32_t Tracer::rank_ = 0;
+    std::chrono::steady_clock::time_point Tracer::start_;
+    std::mutex Tracer::mutex_;
+    std::vector<std::unique_ptr<Tracer::Buffer>> Tracer::buffers_;
+
+    void Tracer::Init(int32_t rank)
+    {
+        rank_ = rank;
+        if (Config::trace_file.empty()) return;
+        start_ = std::chrono::steady_clock::now();
+        enabled_ = true;
+    }
+
+    int64_t Tracer::Now()
+    {
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start_).count();
+    }
+
+    Tracer::Buffer* Tracer::ThreadBuffer()
+    {
+        thread_local Buffer* buffer = nullptr;
+        if (buffer == nullptr)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            buffers_.emplace_back(new Buffer());
+            buffer = buffers_.back().get();
+            buffer->thread_id = static_cast<int32_t>(buffers_.size()) - 1;
+            buffer->count = 0;
+            buffer->events.resize(kTraceBufferSize);
+        }
+        return buffer;
+    }
+
+    void Tracer::Record(const char* name, int64_t begin, int64_t end,
+        int64_t arg)
+    {
+        Buffer* buffer = ThreadBuffer();
+        TraceEvent& event = buffer->events[buffer->count % kTraceBufferSize];
+        event.name = name;
+        event.begin = begin;
+        event.duration = end - begin;
+        event.arg = arg;
+        ++buffer->count;
+    }
+
+    void Tracer::Close()
+    {
+        if (!enabled_) return;
+        enabled_ = false;
+        // one file per process, rank 0 uses the given name
+        std::string file_name = Config::trace_file;
+        if (rank_ != 0) file_name += "." + std::to_string(rank_);
+        FILE* file = fopen(file_name.c_str(), "w");
+        if (file == nullptr)
+        {
+            Log::Error("Failed to open trace file %s\n", file_name.c_str());
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        int64_t num_dropped = 0;
+        bool first = true;
+        fprintf(file, "{\"traceEvents\":[");
+        for (auto& buffer : buffers_)
+        {
+            int64_t begin = 0;
+            if (buffer->count > kTraceBufferSize)
+            {
+                begin = buffer->count - kTraceBufferSize;
+                num_dropped += begin;
+            }
+            for (int64_t i = begin; i < buffer->count; ++i)
+            {
+                const TraceEvent& event = buffer->events[i % kTraceBufferSize];
+                fprintf(file, "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,"
+                    "\"tid\":%d,\"ts\":%lld,\"dur\":%lld",
+                    first ? "" : ",", event.name, rank_, buffer->thread_id,
+                    static_cast<long long>(event.begin),
+                    static_cast<long long>(event.duration));
+                if (event.arg >= 0)
+                {
+                    fprintf(file, ",\"args\":{\"id\":%lld}",
+                        static_cast<long long>(event.arg));
+                }
+                fprintf(file, "}");
+                first = false;
+            }
+        }
+        fprintf(file, "\n],\"displayTimeUnit\":\"ms\"}\n");
+        fclose(file);
+        if (num_dropped > 0)
+        {
+            Log::Info("Trace ring buffers dropped %lld old events\n",
+                static_cast<long long>(num_dropped));
+        }
+    }
+} // namespace lightlda
+} // namespace multiverso
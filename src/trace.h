@@ -0,0 +1,102 @@
+/*!
+ * \file trace.h
+ * \brief Defines a low-overhead timeline tracer in chrome://tracing format
+ */
+
+#ifndef LIGHTLDA_TRACE_H_
+#define LIGHTLDA_TRACE_H_
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace multiverso { namespace lightlda
+{
+    /*! \brief One complete event, i.e. a [begin, end) duration of a scope */
+    struct TraceEvent
+    {
+        /*! \brief event name, must be a string literal */
+        const char* name;
+        /*! \brief begin time in microseconds since Tracer::Init */
+        int64_t begin;
+        /*! \brief duration in microseconds */
+        int64_t duration;
+        /*! \brief user argument, e.g. block or slice id, -1 if not used */
+        int64_t arg;
+    };
+
+    /*!
+     * \brief Tracer records scope events into per-thread ring buffers and
+     *  dumps them as chrome://tracing / Perfetto JSON on Close. Tracing is
+     *  disabled unless Config::trace_file is set, in which case every
+     *  TraceScope costs only a test of a static flag.
+     */
+    class Tracer
+    {
+    public:
+        /*! \brief Enables tracing if required, should call after Config::Init */
+        static void Init(int32_t rank);
+        /*! \brief Dumps recorded events to trace file and disables tracing */
+        static void Close();
+        /*! \brief Whether tracing is enabled */
+        static bool Enabled() { return enabled_; }
+        /*! \brief Microseconds elapsed since Init */
+        static int64_t Now();
+        /*! \brief Records one event into the ring buffer of calling thread */
+        static void Record(const char* name, int64_t begin, int64_t end,
+            int64_t arg);
+    private:
+        /*! \brief Fixed size ring buffer owned by one thread */
+        struct Buffer
+        {
+            int32_t thread_id;
+            int64_t count;
+            std::vector<TraceEvent> events;
+        };
+        static Buffer* ThreadBuffer();
+
+        static bool enabled_;
+        static int32_t rank_;
+        static std::chrono::steady_clock::time_point start_;
+        static std::mutex mutex_;
+        // buffers are owned by Tracer so that events of exited threads
+        // are kept until Close
+        static std::vector<std::unique_ptr<Buffer>> buffers_;
+    };
+
+    /*! \brief RAII helper recording the lifetime of a scope as an event */
+    class TraceScope
+    {
+    public:
+        explicit TraceScope(const char* name, int64_t arg = -1)
+            : name_(name), arg_(arg)
+        {
+            begin_ = Tracer::Enabled() ? Tracer::Now() : -1;
+        }
+        ~TraceScope()
+        {
+            if (begin_ >= 0) Tracer::Record(name_, begin_, Tracer::Now(), arg_);
+        }
+    private:
+        const char* name_;
+        int64_t arg_;
+        int64_t begin_;
+
+        // No copying allowed
+        TraceScope(const TraceScope&);
+        void operator=(const TraceScope&);
+    };
+} // namespace lightlda
+} // namespace multiverso
+
+#define LIGHTLDA_TRACE_CONCAT_(a, b) a##b
+#define LIGHTLDA_TRACE_CONCAT(a, b) LIGHTLDA_TRACE_CONCAT_(a, b)
+/*! \brief Traces the enclosing scope, optionally with an integer argument */
+#define TRACE_SCOPE(...) \
+    multiverso::lightlda::TraceScope \
+    LIGHTLDA_TRACE_CONCAT(trace_scope_, __LINE__)(__VA_ARGS__)
+
+#endif // LIGHTLDA_TRACE_H_
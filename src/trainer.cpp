@@ -5,18 +5,26 @@
 #include "data_block.h"
 #include "eval.h"
 #include "meta.h"
+#include "metrics.h"
 #include "sampler.h"
 #include "model.h"
+#include "row_cache.h"
+#include "trace.h"
 
 #include <multiverso/barrier.h>
 #include <multiverso/stop_watch.h>
 #include <multiverso/log.h>
 
+#include <thread>
+
 namespace multiverso { namespace lightlda
 {
     std::mutex Trainer::mutex_;
     double Trainer::doc_llh_ = 0.0;
     double Trainer::word_llh_ = 0.0;
+    std::atomic<int32_t> Trainer::alias_stage_done_[kAliasPipelineStages];
+    std::vector<int64_t> Trainer::checkpoint_rows_;
+    double Trainer::seconds_per_cost_ = 0.0;
 
     Trainer::Trainer(AliasTable* alias_table, 
 		Barrier* barrier, Meta* meta) : 
@@ -35,7 +43,9 @@ namespace multiverso { namespace lightlda
 
     void Trainer::TrainIteration(DataBlockBase* data_block)
     {
+        TRACE_SCOPE("TrainIteration");
         StopWatch watch; watch.Start();
+        StopWatch slice_watch; slice_watch.Start();
         LDADataBlock* lda_data_block =
             reinterpret_cast<LDADataBlock*>(data_block);
 
@@ -54,30 +64,55 @@ namespace multiverso { namespace lightlda
                 Multiverso::ProcessRank(), lda_data_block->iteration(),
                 lda_data_block->block(), lda_data_block->slice());
         }
+        ThreadStats& stats = sampler_->stats();
+        stats = ThreadStats();
+        // Copy the rows fetched for this slice into the resident store
+        if (RowCache::resident())
+        {
+            const std::vector<int32_t>& refreshed =
+                lda_data_block->refreshed_words();
+            for (size_t i = id; i < refreshed.size(); i += trainer_num)
+            {
+                RowCache::Refresh(refreshed[i],
+                    GetRow<int32_t>(kWordTopicTable, refreshed[i]));
+            }
+        }
         // Build Alias table
         if (id == 0) alias_->Init(meta_->alias_index(block, slice));
-        barrier_->Wait();
-        for (const int32_t* pword = local_vocab.begin(slice) + id;
-            pword < local_vocab.end(slice);
-            pword += trainer_num)
+        Wait();
+        int32_t num_token = 0;
+        if (0 < Config::alias_builders && Config::alias_builders < trainer_num
+            && local_vocab.end(slice) - local_vocab.begin(slice) 
+            >= kAliasPipelineStages)
         {
-            alias_->Build(*pword, model_);
+            num_token = PipelinedTrain(lda_data_block, watch);
         }
-        if (id == 0) alias_->Build(-1, model_);
-        barrier_->Wait();
-
-        if (TrainerId() == 0)
+        else
         {
-            Log::Info("Rank = %d, Alias Time used: %.2f s \n",
-                Multiverso::ProcessRank(), watch.ElapsedSeconds());
-        }
-        int32_t num_token = 0;
-        watch.Restart();
-        // Train with lightlda sampler
-        for (int32_t doc_id = id; doc_id < data.Size(); doc_id += trainer_num)
-        {
-            Document* doc = data.GetOneDoc(doc_id);
-            num_token += sampler_->SampleOneDoc(doc, slice, lastword, model_, alias_);
+            StopWatch alias_watch; alias_watch.Start();
+            {
+                TRACE_SCOPE("BuildAlias", slice);
+                BuildAlias(local_vocab.begin(slice), local_vocab.end(slice),
+                    id, trainer_num);
+                if (id == 0) alias_->Build(-1, model_);
+            }
+            stats.alias_seconds = alias_watch.ElapsedSeconds();
+            Wait();
+
+            if (TrainerId() == 0)
+            {
+                Log::Info("Rank = %d, Alias Time used: %.2f s \n",
+                    Multiverso::ProcessRank(), watch.ElapsedSeconds());
+            }
+            watch.Restart();
+            // Train with lightlda sampler
+            TRACE_SCOPE("Sample", slice);
+            for (int32_t doc_id = id; doc_id < data.Size(); doc_id += trainer_num)
+            {
+                Document doc = data.GetOneDoc(doc_id);
+                num_token += sampler_->SampleOneDoc(&doc, slice, lastword, model_, alias_);
+            }
+            stats.sampling_seconds = watch.ElapsedSeconds();
         }
         if (TrainerId() == 0)
         {
@@ -85,6 +120,8 @@ namespace multiverso { namespace lightlda
                 Multiverso::ProcessRank(), watch.ElapsedSeconds());
             Log::Info("Rank = %d, sampling throughput: %.6f (tokens/thread/sec) \n", 
                 Multiverso::ProcessRank(), double(num_token) / watch.ElapsedSeconds());
+            LogSliceTime(local_vocab.slice_cost(slice),
+                slice_watch.ElapsedSeconds());
         }
         watch.Restart();
         // Evaluate loss function
@@ -97,14 +134,143 @@ namespace multiverso { namespace lightlda
                 Log::Info("Rank = %d, Evaluation Time used: %.2f s \n",
                     Multiverso::ProcessRank(), watch.ElapsedSeconds());
         }
-        // if (iter != 0 && iter % 50 == 0) Dump(iter, lda_data_block);
+        if (Checkpoint::IsDue(iter)) WriteCheckpoint(lda_data_block);
+
+        stats.num_tokens = num_token;
+        Metrics::Commit(iter, block, slice, id, trainer_num, stats);
 
         // Clear the thread information in alias table
         if (iter == Config::num_iterations - 1) alias_->Clear();
     }
 
+    void Trainer::LogSliceTime(double cost, double seconds)
+    {
+        // the time of a unit of cost is calibrated by previous slices
+        if (seconds_per_cost_ > 0.0)
+        {
+            Log::Info("Rank = %d, Slice time predicted: %.2f s, actual: %.2f s\n",
+                Multiverso::ProcessRank(), cost * seconds_per_cost_, seconds);
+            seconds_per_cost_ = 0.5 * seconds_per_cost_ + 0.5 * seconds / cost;
+        }
+        else
+        {
+            seconds_per_cost_ = seconds / cost;
+        }
+    }
+
+    bool Trainer::Wait()
+    {
+        TRACE_SCOPE("Barrier::Wait");
+        StopWatch watch; watch.Start();
+        bool last = barrier_->Wait();
+        sampler_->stats().barrier_seconds += watch.ElapsedSeconds();
+        return last;
+    }
+
+    void Trainer::BuildAlias(const int32_t* begin, const int32_t* end,
+        int32_t id, int32_t num_threads)
+    {
+        for (const int32_t* pword = begin + id; pword < end; 
+            pword += num_threads)
+        {
+            alias_->Build(*pword, model_);
+        }
+    }
+
+    int32_t Trainer::PipelinedTrain(LDADataBlock* lda_data_block, 
+        StopWatch& watch)
+    {
+        DataBlock& data = lda_data_block->data();
+        int32_t slice = lda_data_block->slice();
+        const LocalVocab& local_vocab = data.meta();
+
+        int32_t id = TrainerId();
+        int32_t num_builders = Config::alias_builders;
+        int32_t num_samplers = TrainerCount() - num_builders;
+
+        // Split the slice into stages of contiguous words. The caller 
+        // guarantees every stage is non-empty
+        const int32_t* begin = local_vocab.begin(slice);
+        int64_t num_words = local_vocab.end(slice) - begin;
+        const int32_t* stage_begin[kAliasPipelineStages + 1];
+        for (int32_t stage = 0; stage <= kAliasPipelineStages; ++stage)
+        {
+            stage_begin[stage] = begin + num_words * stage / kAliasPipelineStages;
+        }
+
+        // Every thread has left the previous slice, reset stage counters before
+        // the builders may touch them after the next barrier
+        if (id == 0)
+        {
+            for (int32_t stage = 0; stage < kAliasPipelineStages; ++stage)
+            {
+                alias_stage_done_[stage] = 0;
+            }
+        }
+        // The first stage is built by all threads, since nobody can sample yet
+        ThreadStats& stats = sampler_->stats();
+        StopWatch region_watch; region_watch.Start();
+        {
+            TRACE_SCOPE("BuildAlias", 0);
+            BuildAlias(stage_begin[0], stage_begin[1], id, TrainerCount());
+            if (id == 0) alias_->Build(-1, model_);
+        }
+        stats.alias_seconds = region_watch.ElapsedSeconds();
+        Wait();
+        if (id == 0)
+        {
+            Log::Info("Rank = %d, Alias Time used (first stage): %.2f s \n",
+                Multiverso::ProcessRank(), watch.ElapsedSeconds());
+        }
+        watch.Restart();
+
+        // Builders build stage i + 1 while samplers work on stage i
+        if (id >= num_samplers)
+        {
+            region_watch.Restart();
+            for (int32_t stage = 1; stage < kAliasPipelineStages; ++stage)
+            {
+                TRACE_SCOPE("BuildAlias", stage);
+                BuildAlias(stage_begin[stage], stage_begin[stage + 1],
+                    id - num_samplers, num_builders);
+                ++alias_stage_done_[stage];
+            }
+            stats.alias_seconds += region_watch.ElapsedSeconds();
+            return 0;
+        }
+        int32_t num_token = 0;
+        for (int32_t stage = 0; stage < kAliasPipelineStages; ++stage)
+        {
+            region_watch.Restart();
+            {
+                TRACE_SCOPE("WaitAliasStage", stage);
+                while (stage != 0 && alias_stage_done_[stage] < num_builders)
+                {
+                    std::this_thread::yield();
+                }
+            }
+            stats.barrier_seconds += region_watch.ElapsedSeconds();
+            region_watch.Restart();
+            TRACE_SCOPE("Sample", stage);
+            int32_t lastword = *(stage_begin[stage + 1] - 1);
+            // Stages act as sub-slices, only the very first one resets
+            // the document cursor
+            int32_t sub_slice = slice * kAliasPipelineStages + stage;
+            for (int32_t doc_id = id; doc_id < data.Size(); 
+                doc_id += num_samplers)
+            {
+                Document doc = data.GetOneDoc(doc_id);
+                num_token += sampler_->SampleOneDoc(&doc, sub_slice, lastword,
+                    model_, alias_);
+            }
+            stats.sampling_seconds += region_watch.ElapsedSeconds();
+        }
+        return num_token;
+    }
+
     void Trainer::Evaluate(LDADataBlock* lda_data_block)
     {
+        TRACE_SCOPE("Evaluate");
         double thread_doc = 0, thread_word = 0;
 
         DataBlock& data = lda_data_block->data();
@@ -116,16 +282,18 @@ namespace multiverso { namespace lightlda
         for (int32_t doc_id = TrainerId(); doc_id < data.Size() && slice == 0;
             doc_id += TrainerCount())
         {
-            thread_doc += Eval::ComputeOneDocLLH(data.GetOneDoc(doc_id),
+            Document doc = data.GetOneDoc(doc_id);
+            thread_doc += Eval::ComputeOneDocLLH(&doc,
                 sampler_->doc_topic_counter());
         }
         {
             std::lock_guard<std::mutex> lock(mutex_);
             doc_llh_ += thread_doc;
         }
-        if (slice == 0 && barrier_->Wait())
+        if (slice == 0 && Wait())
         {
             Log::Info("doc likelihood : %e\n", doc_llh_);
+            Metrics::RecordLikelihood(Likelihood::Doc, doc_llh_);
             doc_llh_ = 0;
         }
 
@@ -139,68 +307,107 @@ namespace multiverso { namespace lightlda
             std::lock_guard<std::mutex> lock(mutex_);
             word_llh_ += thread_word;
         }
-        if (block == 0 && barrier_->Wait())
+        if (block == 0 && Wait())
         {
             Log::Info("word likelihood : %e\n", word_llh_);
+            Metrics::RecordLikelihood(Likelihood::Word, word_llh_);
             word_llh_ = 0;
         }
 
         // 3. Evaluate normalize item for word likelihood
         if (TrainerId() == 0 && block == 0)
         {
-            Log::Info("Normalized likelihood : %e\n",
-                Eval::NormalizeWordLLH(this));
+            double normalized_llh = Eval::NormalizeWordLLH(this);
+            Log::Info("Normalized likelihood : %e\n", normalized_llh);
+            Metrics::RecordLikelihood(Likelihood::Normalized, normalized_llh);
         }
-        barrier_->Wait();
+        Wait();
     }
 
-    void Trainer::Dump(int32_t iter, LDADataBlock* lda_data_block)
+    void Trainer::WriteCheckpoint(LDADataBlock* lda_data_block)
     {
+        TRACE_SCOPE("Checkpoint");
         DataBlock& data = lda_data_block->data();
+        int32_t block = lda_data_block->block();
         int32_t slice = lda_data_block->slice();
+        int32_t iter = lda_data_block->iteration();
         const LocalVocab& local_vocab = data.meta();
+        int32_t id = TrainerId();
+        int32_t trainer_num = TrainerCount();
+        std::string dir = Checkpoint::Directory(iter);
 
-        std::string out = "model." + std::to_string(iter) + "." 
-            + std::to_string(slice) + "." + std::to_string(TrainerId());
-        std::ofstream fout(out);
-
-        for (const int32_t* p = local_vocab.begin(slice) + TrainerId();
-            p < local_vocab.end(slice); p += TrainerCount())
+        if (id == 0 && block == 0 && slice == 0)
         {
-            int word = *p;
-            Row<int32_t>& row = GetRow<int32_t>(kWordTopicTable, word);
-            Row<int32_t>::iterator iter = row.Iterator();
-
-            fout << word;
-            while (iter.HasNext())
+            Checkpoint::CreateDirectory(dir);
+            checkpoint_rows_.assign(trainer_num, 0);
+        }
+        // rows and topics are final once every thread finished sampling,
+        // they are copied into snapshots and written in the background
+        Wait();
+        if (!checkpoint_.is_open()) checkpoint_.Open(dir, id);
+        for (const int32_t* p = local_vocab.begin(slice) + id;
+            p < local_vocab.end(slice); p += trainer_num)
+        {
+            if (Checkpoint::OwnsWord(block, *p))
             {
-                int32_t topic = iter.Key();
-                int32_t count = iter.Value();
-                fout << " " << topic << ":" << count;
-                iter.Next();
+                checkpoint_.WriteRow(*p, model_->GetWordTopicRow(*p));
             }
-            fout << std::endl;
         }
+        if (slice != local_vocab.num_slice() - 1) return;
 
-        fout.close();
+        if (Config::checkpoint_doc_topic)
+        {
+            int32_t doc_begin, doc_end;
+            Checkpoint::PartRange(data.Size(), id, trainer_num,
+                doc_begin, doc_end);
+            Checkpoint::WriteDocTopics(dir, block, id, data,
+                doc_begin, doc_end);
+        }
+        if (block != Config::num_blocks - 1) return;
+
+        checkpoint_.Close();
+        checkpoint_rows_[id] = checkpoint_.num_rows();
+        if (Wait())
+        {
+            Checkpoint::WriteSummary(dir, GetRow<int64_t>(kSummaryRow, 0));
+            CheckpointManifest manifest;
+            manifest.iteration = iter;
+            manifest.num_vocabs = Config::num_vocabs;
+            manifest.num_topics = Config::num_topics;
+            manifest.num_blocks = Config::num_blocks;
+            manifest.num_shards = trainer_num;
+            manifest.has_doc_topic = Config::checkpoint_doc_topic;
+            manifest.shard_rows = checkpoint_rows_;
+            Checkpoint::WriteManifest(dir, manifest);
+        }
     }
 
     void ParamLoader::ParseAndRequest(DataBlockBase* data_block)
     {
+        TRACE_SCOPE("ParamLoader::ParseAndRequest");
         LDADataBlock* lda_data_block =
             reinterpret_cast<LDADataBlock*>(data_block);
         // Request word-topic-table
         int32_t slice = lda_data_block->slice();
+        int32_t iteration = lda_data_block->iteration();
         DataBlock& data = lda_data_block->data();
         const LocalVocab& local_vocab = data.meta();
 
+        // resident rows are up to date with local deltas in RowCache, and
+        // are only requested when RowCache refreshes them
+        std::vector<int32_t>& refreshed = lda_data_block->refreshed_words();
         for (const int32_t* p = local_vocab.begin(slice);
             p != local_vocab.end(slice); ++p)
         {
-            RequestRow(kWordTopicTable, *p);
+            if (RowCache::NeedRefresh(*p, iteration))
+            {
+                RequestRow(kWordTopicTable, *p);
+                refreshed.push_back(*p);
+            }
         }
-        Log::Debug("Request params. start = %d, end = %d\n",
-            *local_vocab.begin(slice), *(local_vocab.end(slice) - 1));
+        Log::Debug("Request params. start = %d, end = %d, rows = %d\n",
+            *local_vocab.begin(slice), *(local_vocab.end(slice) - 1),
+            static_cast<int32_t>(refreshed.size()));
         // Request summary-row
         RequestTable(kSummaryRow);
     }